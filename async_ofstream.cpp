@@ -0,0 +1,283 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Implementation of classes AsyncFileBuf and AsyncOfstream.
+*/
+
+#include "precompiled.h"
+
+#include "async_ofstream.h"
+
+namespace
+{
+  //! Alignment of buffers, and of offsets and sizes written with O_DIRECT.
+  const size_t alignment=4096;
+
+  //! Size of each buffer, unless a smaller file is expected.
+  const size_t default_buffer_size=(1u<<23);
+}
+
+bool AsyncFileBuf::_use_direct=false;
+
+unsigned long long AsyncFileBuf::_direct_minimum_size=(1ull<<26);
+
+void AsyncFileBuf::set_direct(bool direct,unsigned long long minimum_size)
+{
+  _use_direct=direct;
+  _direct_minimum_size=minimum_size;
+}
+
+AsyncFileBuf::AsyncFileBuf()
+  :_fd(-1)
+  ,_direct(false)
+  ,_preallocated(false)
+  ,_buffer_size(0)
+  ,_filling(0)
+  ,_offset(0)
+  ,_end(0)
+  ,_queued(0)
+  ,_queued_size(0)
+  ,_queued_offset(0)
+  ,_stop(false)
+  ,_error(false)
+{
+  _buffers[0]=0;
+  _buffers[1]=0;
+}
+
+AsyncFileBuf::~AsyncFileBuf()
+{
+  if (is_open()) close();
+  free(_buffers[0]);
+  free(_buffers[1]);
+}
+
+bool AsyncFileBuf::open(const std::string& filename,unsigned long long expected_size)
+{
+  if (is_open()) return false;
+
+  const int flags=O_WRONLY|O_CREAT|O_TRUNC;
+#ifdef O_DIRECT
+  if (_use_direct && expected_size>=_direct_minimum_size)
+    {
+      _fd=::open(filename.c_str(),flags|O_DIRECT,0666);
+      _direct=(_fd!=-1);
+    }
+#endif
+  if (_fd==-1) _fd=::open(filename.c_str(),flags,0666);
+  if (_fd==-1) return false;
+
+  // Not all filesystems support preallocation; it's only an optimisation.
+  if (expected_size) _preallocated=(posix_fallocate(_fd,0,expected_size)==0);
+
+  _buffer_size=default_buffer_size;
+  if (expected_size && expected_size<_buffer_size)
+    _buffer_size=static_cast<size_t>(((expected_size+alignment-1)/alignment)*alignment);
+
+  void* buffer=0;
+  if (posix_memalign(&buffer,alignment,_buffer_size)!=0)
+    {
+      ::close(_fd);
+      _fd=-1;
+      return false;
+    }
+  _buffers[0]=static_cast<char*>(buffer);
+  _filling=0;
+  _offset=0;
+  _end=0;
+  _error=false;
+  _stop=false;
+  setp(_buffers[0],_buffers[0]+_buffer_size);
+  return true;
+}
+
+/*! If nothing was ever handed off, the file fits in a buffer and is just written by this thread.
+ */
+bool AsyncFileBuf::close()
+{
+  if (!is_open()) return false;
+
+  if (_writer)
+    {
+      if (pptr()>pbase()) hand_off();
+      {
+        boost::mutex::scoped_lock lock(_mutex);
+        while (_queued) _changed.wait(lock);
+        _stop=true;
+        _changed.notify_all();
+      }
+      _writer->join();
+      _writer.reset();
+    }
+  else if (pptr()>pbase())
+    {
+      const size_t size=pptr()-pbase();
+      if (!write_fully(pbase(),size,_offset)) _error=true;
+      _end=std::max(_end,_offset+size);
+    }
+  setp(0,0);
+
+  if (_preallocated && ftruncate(_fd,_end)!=0) _error=true;
+  if (::close(_fd)!=0) _error=true;
+  _fd=-1;
+  _direct=false;
+  _preallocated=false;
+  return !_error;
+}
+
+AsyncFileBuf::int_type AsyncFileBuf::overflow(int_type c)
+{
+  if (!is_open() || !hand_off()) return traits_type::eof();
+  if (traits_type::eq_int_type(c,traits_type::eof())) return traits_type::not_eof(c);
+  *pptr()=traits_type::to_char_type(c);
+  pbump(1);
+  return c;
+}
+
+int AsyncFileBuf::sync()
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  return (_error ? -1 : 0);
+}
+
+AsyncFileBuf::pos_type AsyncFileBuf::seekoff(off_type off,std::ios_base::seekdir dir,std::ios_base::openmode which)
+{
+  if (!is_open() || !(which&std::ios_base::out)) return pos_type(off_type(-1));
+
+  const unsigned long long position=_offset+(pptr()-pbase());
+  if (dir==std::ios_base::cur && off==0) return pos_type(position);  // Just tellp
+
+  unsigned long long base=0;
+  if (dir==std::ios_base::cur)
+    base=position;
+  else if (dir==std::ios_base::end)
+    base=std::max(_end,position);
+  if (off<0 && static_cast<unsigned long long>(-off)>base) return pos_type(off_type(-1));
+
+  if (pptr()>pbase() && !hand_off()) return pos_type(off_type(-1));
+  _offset=base+off;
+  return pos_type(_offset);
+}
+
+AsyncFileBuf::pos_type AsyncFileBuf::seekpos(pos_type pos,std::ios_base::openmode which)
+{
+  return seekoff(off_type(pos),std::ios_base::beg,which);
+}
+
+/*! Waits for any buffer already queued to be written first, so writes happen in the order they're made
+  (which matters if a seek back overwrites earlier output).
+ */
+bool AsyncFileBuf::hand_off()
+{
+  const size_t size=pptr()-pbase();
+  if (size==0) return !_error;
+
+  if (!_buffers[1])
+    {
+      void* buffer=0;
+      if (posix_memalign(&buffer,alignment,_buffer_size)!=0) return false;
+      _buffers[1]=static_cast<char*>(buffer);
+    }
+  if (!_writer) _writer.reset(new boost::thread(boost::bind(&AsyncFileBuf::drain,this)));
+
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+    while (_queued) _changed.wait(lock);
+    if (_error) return false;
+    _queued=pbase();
+    _queued_size=size;
+    _queued_offset=_offset;
+    _changed.notify_all();
+  }
+
+  _end=std::max(_end,_offset+size);
+  _offset+=size;
+  _filling=1-_filling;
+  setp(_buffers[_filling],_buffers[_filling]+_buffer_size);
+  return true;
+}
+
+void AsyncFileBuf::drain()
+{
+  for (;;)
+    {
+      const char* data;
+      size_t size;
+      unsigned long long offset;
+      {
+        boost::mutex::scoped_lock lock(_mutex);
+        while (!_queued && !_stop) _changed.wait(lock);
+        if (!_queued) return;
+        data=_queued;
+        size=_queued_size;
+        offset=_queued_offset;
+      }
+
+      const bool ok=write_fully(data,size,offset);
+
+      {
+        boost::mutex::scoped_lock lock(_mutex);
+        if (!ok) _error=true;
+        _queued=0;
+        _changed.notify_all();
+      }
+    }
+}
+
+bool AsyncFileBuf::write_fully(const char* data,size_t size,unsigned long long offset)
+{
+#ifdef O_DIRECT
+  if (_direct && (offset%alignment || size%alignment))
+    {
+      const int flags=fcntl(_fd,F_GETFL);
+      if (flags==-1 || fcntl(_fd,F_SETFL,flags&~O_DIRECT)==-1) return false;
+      _direct=false;
+    }
+#endif
+
+  while (size)
+    {
+      const ssize_t written=pwrite(_fd,data,size,static_cast<off_t>(offset));
+      if (written<0)
+        {
+          if (errno==EINTR) continue;
+          return false;
+        }
+      data+=written;
+      size-=written;
+      offset+=written;
+    }
+  return true;
+}
+
+AsyncOfstream::AsyncOfstream(const std::string& filename,unsigned long long expected_size)
+  :std::ostream(0)
+{
+  rdbuf(&_buf);
+  if (!_buf.open(filename,expected_size)) setstate(std::ios_base::failbit);
+}
+
+AsyncOfstream::~AsyncOfstream()
+{}
+
+void AsyncOfstream::close()
+{
+  if (!_buf.close()) setstate(std::ios_base::failbit);
+}
@@ -0,0 +1,156 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Interface for classes AsyncFileBuf and AsyncOfstream.
+*/
+
+#ifndef _async_ofstream_h_
+#define _async_ofstream_h_
+
+//! Stream buffer which writes to a file from a background thread.
+/*! Output is put into one large buffer while the previously filled one is written out,
+  so formatting and disk writes overlap (which matters most on slow or network filesystems).
+  Buffers are written with pwrite at their own offsets, so seeking back (to patch a header) works.
+  sync() doesn't force anything out (std::endl shouldn't cost a write), so data is only known
+  to be written, and errors are only reported, once close() returns.
+
+  If a size is expected, the file is preallocated with posix_fallocate (and trimmed to what
+  was actually written on close), and buffers needn't be any larger than that.
+  Huge files can also bypass the page cache with O_DIRECT (see set_direct);
+  this is dropped for any write which isn't suitably aligned (such as the end of the file).
+ */
+class AsyncFileBuf : public std::streambuf, public boost::noncopyable
+{
+ public:
+
+  //! Constructor.
+  AsyncFileBuf();
+
+  //! Destructor.  Closes any open file.
+  ~AsyncFileBuf();
+
+  //! Create (or truncate) a file for writing, with expected_size bytes expected if it's non-zero.
+  bool open(const std::string& filename,unsigned long long expected_size);
+
+  //! Whether a file is open.
+  bool is_open() const
+    {
+      return (_fd!=-1);
+    }
+
+  //! Write out everything and close the file.  Returns false if there were any errors.
+  bool close();
+
+  //! Whether files of expected_size bytes or more are written with O_DIRECT, where supported.
+  static void set_direct(bool direct,unsigned long long minimum_size=(1ull<<26));
+
+ protected:
+
+  virtual int_type overflow(int_type c);
+
+  virtual int sync();
+
+  virtual pos_type seekoff(off_type off,std::ios_base::seekdir dir,std::ios_base::openmode which);
+
+  virtual pos_type seekpos(pos_type pos,std::ios_base::openmode which);
+
+ private:
+
+  //! Queue the put area for writing and switch to the other buffer.
+  bool hand_off();
+
+  //! Wait until the writer thread has written everything queued.
+  void wait_written();
+
+  //! Writer thread body.
+  void drain();
+
+  //! pwrite all of size bytes at offset, dropping O_DIRECT if they aren't aligned for it.
+  bool write_fully(const char* data,size_t size,unsigned long long offset);
+
+  int _fd;
+
+  //! Whether the file is open with O_DIRECT.
+  bool _direct;
+
+  //! Whether the file was preallocated (so needs trimming).
+  bool _preallocated;
+
+  size_t _buffer_size;
+
+  //! The two buffers (the second only allocated once needed), and which is being filled.
+  boost::array<char*,2> _buffers;
+  uint _filling;
+
+  //! File offset of the start of the put area.
+  unsigned long long _offset;
+
+  //! End of the furthest write so far.
+  unsigned long long _end;
+
+  boost::scoped_ptr<boost::thread> _writer;
+
+  //! Guards the members below, shared with the writer thread.
+  boost::mutex _mutex;
+
+  //! Signalled as a buffer is queued, or written.
+  boost::condition_variable _changed;
+
+  //! Buffer queued for writing (or being written), if any.
+  const char* _queued;
+  size_t _queued_size;
+  unsigned long long _queued_offset;
+
+  bool _stop;
+
+  bool _error;
+
+  static bool _use_direct;
+
+  static unsigned long long _direct_minimum_size;
+};
+
+//! Output file stream writing through an AsyncFileBuf.
+/*! A drop-in for std::ofstream (always binary) for exporters which write through a std::ostream.
+ */
+class AsyncOfstream : public std::ostream
+{
+ public:
+
+  //! Constructor.  Opens the file; expected_size (if known) is the number of bytes expected to be written.
+  explicit AsyncOfstream(const std::string& filename,unsigned long long expected_size=0);
+
+  //! Destructor.
+  ~AsyncOfstream();
+
+  bool is_open() const
+    {
+      return _buf.is_open();
+    }
+
+  //! Write out everything and close the file, setting failbit if there were any errors.
+  void close();
+
+ private:
+
+  AsyncFileBuf _buf;
+};
+
+#endif
@@ -28,16 +28,26 @@
 
 extern "C"
 {
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 #include <time.h>
+#include <unistd.h>
+#include <zlib.h>
 }
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstring>
 #include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <map>
 #include <memory>
 #include <numeric>
@@ -59,6 +69,12 @@ extern "C"
 #include <boost/range.hpp>
 #include <boost/scoped_array.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/weak_ptr.hpp>
 
 #include <QApplication>
 #include <QButtonGroup>
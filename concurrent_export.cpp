@@ -0,0 +1,171 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Implementation of class ConcurrentExport.
+*/
+
+#include "precompiled.h"
+
+#include "concurrent_export.h"
+
+ConcurrentExport::Job::Job(const std::string& n,const boost::function<bool ()>& f)
+  :name(n)
+  ,fn(f)
+  ,info(n)
+  ,steps(0)
+  ,step(0)
+  ,finished(false)
+  ,ok(false)
+{}
+
+ConcurrentExport::ConcurrentExport()
+  :_unfinished(0)
+{}
+
+ConcurrentExport::~ConcurrentExport()
+{
+  _threads.join_all();
+}
+
+void ConcurrentExport::add(const std::string& name,const boost::function<bool ()>& job)
+{
+  _jobs.push_back(Job(name,job));
+}
+
+void ConcurrentExport::start()
+{
+  _unfinished=_jobs.size();
+  for (uint j=0;j<_jobs.size();j++)
+    _threads.create_thread(boost::bind(&ConcurrentExport::run,this,j));
+}
+
+bool ConcurrentExport::wait(uint milliseconds)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  if (_unfinished) _job_finished.timed_wait(lock,boost::posix_time::milliseconds(milliseconds));
+  return (_unfinished==0);
+}
+
+uint ConcurrentExport::percent() const
+{
+  if (_jobs.empty()) return 100;
+
+  boost::mutex::scoped_lock lock(_mutex);
+  uint total=0;
+  for (uint j=0;j<_jobs.size();j++)
+    {
+      const Job& job=_jobs[j];
+      if (job.finished)
+        total+=100;
+      else if (job.steps)
+        total+=(100*std::min(job.step,job.steps))/job.steps;
+    }
+  return total/_jobs.size();
+}
+
+std::string ConcurrentExport::info() const
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  std::string ret;
+  for (uint j=0;j<_jobs.size();j++)
+    if (!_jobs[j].finished)
+      {
+        if (!ret.empty()) ret+="\n";
+        ret+=_jobs[j].name+": "+_jobs[j].info;
+      }
+  return ret;
+}
+
+std::vector<std::string> ConcurrentExport::failed() const
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  std::vector<std::string> ret;
+  for (uint j=0;j<_jobs.size();j++)
+    if (_jobs[j].finished && !_jobs[j].ok)
+      ret.push_back(_jobs[j].name);
+  return ret;
+}
+
+bool ConcurrentExport::in_job_thread() const
+{
+  return (_job_of_thread.get()!=0);
+}
+
+void ConcurrentExport::progress_start(uint steps,const std::string& info)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  if (Job*const job=current())
+    {
+      job->info=info;
+      job->steps=steps;
+      job->step=0;
+    }
+}
+
+void ConcurrentExport::progress_stall(const std::string& reason)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  if (Job*const job=current()) job->info=reason;
+}
+
+void ConcurrentExport::progress_step(uint step)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  if (Job*const job=current()) job->step=step;
+}
+
+void ConcurrentExport::progress_complete(const std::string& info)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  if (Job*const job=current())
+    {
+      job->info=info;
+      job->step=job->steps;
+    }
+}
+
+/*! Exceptions (bad_alloc, most likely) count as failure rather than escaping the thread.
+ */
+void ConcurrentExport::run(uint j)
+{
+  _job_of_thread.reset(new uint(j));
+
+  bool ok=false;
+  try
+    {
+      ok=_jobs[j].fn();
+    }
+  catch (const std::exception&)
+    {
+      ok=false;
+    }
+
+  boost::mutex::scoped_lock lock(_mutex);
+  _jobs[j].finished=true;
+  _jobs[j].ok=ok;
+  _unfinished--;
+  _job_finished.notify_all();
+}
+
+ConcurrentExport::Job* ConcurrentExport::current()
+{
+  const uint*const j=_job_of_thread.get();
+  return (j ? &_jobs[*j] : 0);
+}
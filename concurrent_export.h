@@ -0,0 +1,116 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Interface for class ConcurrentExport.
+*/
+
+#ifndef _concurrent_export_h_
+#define _concurrent_export_h_
+
+#include "progress.h"
+
+//! Runs export jobs concurrently, each on its own thread, and aggregates their progress.
+/*! Jobs report progress through the Progress methods (from their own threads only;
+  a parallel_for only reports from its calling thread, so jobs' parallel loops are fine).
+  Meshes report to the Progress they were built with, so that needs to forward calls made
+  from a job's thread here (see in_job_thread).
+  The other methods are for the thread which owns this object, to display progress and
+  wait for the jobs.
+ */
+class ConcurrentExport : public Progress, public boost::noncopyable
+{
+ public:
+
+  //! Constructor.
+  ConcurrentExport();
+
+  //! Destructor.  Waits for any jobs still running.
+  ~ConcurrentExport();
+
+  //! Add a job, named for progress and error reports, which returns false on failure.
+  /*! All jobs must be added before start().
+   */
+  void add(const std::string& name,const boost::function<bool ()>& job);
+
+  //! Start a thread for each job.
+  void start();
+
+  //! Wait up to the given time for the jobs to finish.  Returns true once they all have.
+  bool wait(uint milliseconds);
+
+  //! Percentage complete: the mean of the jobs' progress through their current stages (100 for finished jobs).
+  uint percent() const;
+
+  //! A line for each unfinished job, describing its current stage.
+  std::string info() const;
+
+  //! Names of the jobs which failed (returned false, or threw).
+  std::vector<std::string> failed() const;
+
+  //! Whether the calling thread is one of the jobs'.
+  bool in_job_thread() const;
+
+  virtual void progress_start(uint steps,const std::string& info);
+  virtual void progress_stall(const std::string& reason);
+  virtual void progress_step(uint step);
+  virtual void progress_complete(const std::string& info);
+
+ private:
+
+  //! State of a job.
+  struct Job
+  {
+    Job(const std::string& n,const boost::function<bool ()>& f);
+
+    std::string name;
+    boost::function<bool ()> fn;
+
+    //! Current stage's description, and progress through it.
+    std::string info;
+    uint steps;
+    uint step;
+
+    bool finished;
+    bool ok;
+  };
+
+  //! Thread body for job j.
+  void run(uint j);
+
+  //! The calling thread's job (which must be locked), or null if it's not a job's thread.
+  Job* current();
+
+  std::vector<Job> _jobs;
+
+  //! Index of the job each job thread is running.
+  boost::thread_specific_ptr<uint> _job_of_thread;
+
+  //! Guards the jobs' progress and _unfinished.
+  mutable boost::mutex _mutex;
+
+  //! Signalled as jobs finish.
+  boost::condition_variable _job_finished;
+
+  uint _unfinished;
+
+  boost::thread_group _threads;
+};
+
+#endif
@@ -52,6 +52,32 @@ ControlSave::ControlSave(FracplanetMain* save_target,ParametersSave* param)
       this,SLOT(setSeaSphere(int))
       );
 
+  QCheckBox*const palette_checkbox=new QCheckBox("Palette of textures");
+  tab_pov->layout()->addWidget(palette_checkbox);
+  palette_checkbox->setChecked(parameters->pov_palette);
+  palette_checkbox->setToolTip("Select to emit a single texture for each distinct vertex colour (instead of one per vertex)\nfor much smaller files which POV-Ray parses much faster");
+  connect(
+      palette_checkbox,SIGNAL(stateChanged(int)),
+      this,SLOT(setPovPalette(int))
+      );
+
+  QWidget*const grid_palette=new QWidget();
+  tab_pov->layout()->addWidget(grid_palette);
+  QGridLayout* grid_palette_layout=new QGridLayout();
+  grid_palette->setLayout(grid_palette_layout);
+
+  grid_palette_layout->addWidget(new QLabel("Palette bits per channel",grid_palette),0,0);
+  QSpinBox* palette_bits_spinbox=new QSpinBox();
+  grid_palette_layout->addWidget(palette_bits_spinbox,0,1);
+  palette_bits_spinbox->setMinimum(1);
+  palette_bits_spinbox->setMaximum(8);
+  palette_bits_spinbox->setValue(parameters->pov_palette_bits);
+  palette_bits_spinbox->setToolTip("Bits each colour component is quantised to for the palette\n(8 for exact colours; fewer for fewer, shared, textures)");
+  connect(
+      palette_bits_spinbox,SIGNAL(valueChanged(int)),
+      this,SLOT(setPovPaletteBits(int))
+      );
+
   QPushButton*const save_pov=new QPushButton("Save for POV-Ray");
   tab_pov->layout()->addWidget(save_pov);
   save_pov->setToolTip("Press to save object for POV-Ray");
@@ -81,6 +107,90 @@ ControlSave::ControlSave(FracplanetMain* save_target,ParametersSave* param)
       save_target,SLOT(save_blender())
       );
 
+  QWidget*const tab_gltf=new QWidget();
+  tabs->addTab(tab_gltf,"glTF");
+  tab_gltf->setLayout(new QVBoxLayout());
+
+  QCheckBox*const gltf_quantise=new QCheckBox("Quantise attributes");
+  tab_gltf->layout()->addWidget(gltf_quantise);
+  gltf_quantise->setChecked(parameters->gltf_quantise);
+  gltf_quantise->setToolTip("Check to store vertex positions as 16-bit and normals as 8-bit integers\nfor a smaller file (needs a loader supporting KHR_mesh_quantization)");
+  connect(
+      gltf_quantise,SIGNAL(stateChanged(int)),
+      this,SLOT(setGltfQuantise(int))
+      );
+
+  QPushButton*const save_gltf=new QPushButton("Save as glTF");
+  tab_gltf->layout()->addWidget(save_gltf);
+  save_gltf->setToolTip("Press to save object as a binary glTF (.glb) file");
+  connect(
+      save_gltf,SIGNAL(clicked()),
+      save_target,SLOT(save_gltf())
+      );
+
+  QWidget*const tab_mesh=new QWidget();
+  tabs->addTab(tab_mesh,"PLY/OBJ");
+  tab_mesh->setLayout(new QVBoxLayout());
+
+  QCheckBox*const mesh_obj=new QCheckBox("OBJ (text) format");
+  tab_mesh->layout()->addWidget(mesh_obj);
+  mesh_obj->setChecked(parameters->mesh_obj);
+  mesh_obj->setToolTip("Check to save meshes (and DEM meshes saved with textures) as ASCII OBJ\nrather than binary PLY files");
+  connect(
+      mesh_obj,SIGNAL(stateChanged(int)),
+      this,SLOT(setMeshObj(int))
+      );
+
+  QPushButton*const save_mesh=new QPushButton("Save as PLY/OBJ");
+  tab_mesh->layout()->addWidget(save_mesh);
+  save_mesh->setToolTip("Press to save object as PLY or OBJ mesh files (with per-vertex normals and colours)");
+  connect(
+      save_mesh,SIGNAL(clicked()),
+      save_target,SLOT(save_mesh())
+      );
+
+  QWidget*const tab_decimation=new QWidget();
+  tabs->addTab(tab_decimation,"Decimation");
+  tab_decimation->setLayout(new QVBoxLayout());
+
+  QCheckBox*const decimate_checkbox=new QCheckBox("Decimate terrain");
+  tab_decimation->layout()->addWidget(decimate_checkbox);
+  decimate_checkbox->setChecked(parameters->decimate);
+  decimate_checkbox->setToolTip("Check to simplify the terrain mesh saved for POV-Ray, Blender, glTF, PLY or OBJ.\nRivers, coastlines and the land/sea split are preserved.");
+  connect(
+      decimate_checkbox,SIGNAL(stateChanged(int)),
+      this,SLOT(setDecimate(int))
+      );
+
+  QWidget*const grid_decimation=new QWidget();
+  tab_decimation->layout()->addWidget(grid_decimation);
+  QGridLayout* grid_decimation_layout=new QGridLayout();
+  grid_decimation->setLayout(grid_decimation_layout);
+
+  grid_decimation_layout->addWidget(new QLabel("Target triangles",grid_decimation),0,0);
+  QSpinBox* decimate_triangles_spinbox=new QSpinBox();
+  grid_decimation_layout->addWidget(decimate_triangles_spinbox,0,1);
+  decimate_triangles_spinbox->setMinimum(0);
+  decimate_triangles_spinbox->setMaximum(0x7fffffff);
+  decimate_triangles_spinbox->setValue(parameters->decimate_triangles);
+  decimate_triangles_spinbox->setToolTip("Number of triangles to decimate down to (0 for no limit)");
+  connect(
+      decimate_triangles_spinbox,SIGNAL(valueChanged(int)),
+      this,SLOT(setDecimateTriangles(int))
+      );
+
+  grid_decimation_layout->addWidget(new QLabel("Error tolerance (1/10000 radius)",grid_decimation),1,0);
+  QSpinBox* decimate_error_spinbox=new QSpinBox();
+  grid_decimation_layout->addWidget(decimate_error_spinbox,1,1);
+  decimate_error_spinbox->setMinimum(0);
+  decimate_error_spinbox->setMaximum(10000);
+  decimate_error_spinbox->setValue(static_cast<int>(parameters->decimate_error*10000.0f+0.5f));
+  decimate_error_spinbox->setToolTip("Largest allowed deviation of the decimated surface from the original,\nin units of 1/10000 of the planet radius (0 for no limit)");
+  connect(
+      decimate_error_spinbox,SIGNAL(valueChanged(int)),
+      this,SLOT(setDecimateError(int))
+      );
+
   QWidget*const tab_texture=new QWidget();
   tabs->addTab(tab_texture,"Texture");
   tab_texture->setLayout(new QVBoxLayout());
@@ -94,6 +204,42 @@ ControlSave::ControlSave(FracplanetMain* save_target,ParametersSave* param)
       this,SLOT(setTextureShaded(int))
       );
 
+  QCheckBox*const png_checkbox=new QCheckBox("PNG texture");
+  tab_texture->layout()->addWidget(png_checkbox);
+  png_checkbox->setChecked(parameters->texture_png);
+  png_checkbox->setToolTip("Check to save the textures as compressed PNG images (16-bit greyscale for the DEM)\nrather than uncompressed PPM/PGM images");
+  connect(
+      png_checkbox,SIGNAL(stateChanged(int)),
+      this,SLOT(setTexturePNG(int))
+      );
+
+  QCheckBox*const dem_mesh_checkbox=new QCheckBox("DEM mesh");
+  tab_texture->layout()->addWidget(dem_mesh_checkbox);
+  dem_mesh_checkbox->setChecked(parameters->texture_dem_mesh);
+  dem_mesh_checkbox->setToolTip("Check to also save the DEM as a grid mesh (PLY or OBJ, as selected on the PLY/OBJ tab)\nwith a vertex for each pixel (not for cube maps)");
+  connect(
+      dem_mesh_checkbox,SIGNAL(stateChanged(int)),
+      this,SLOT(setTextureDemMesh(int))
+      );
+
+  QCheckBox*const cube_map_checkbox=new QCheckBox("Cube map texture");
+  tab_texture->layout()->addWidget(cube_map_checkbox);
+  cube_map_checkbox->setChecked(parameters->texture_cube_map);
+  cube_map_checkbox->setToolTip("Check to save planets' textures as the six faces of a cube map\n(each face is sized for the same resolution at its centre as the usual texture has along the equator)");
+  connect(
+      cube_map_checkbox,SIGNAL(stateChanged(int)),
+      this,SLOT(setTextureCubeMap(int))
+      );
+
+  QCheckBox*const tiled_checkbox=new QCheckBox("Tiled texture pyramid");
+  tab_texture->layout()->addWidget(tiled_checkbox);
+  tiled_checkbox->setChecked(parameters->texture_tiled);
+  tiled_checkbox->setToolTip("Check to save the textures as directories of fixed-size tiles,\nwith a level for each halving of the resolution (for virtual texture viewers)");
+  connect(
+      tiled_checkbox,SIGNAL(stateChanged(int)),
+      this,SLOT(setTextureTiled(int))
+      );
+
   QWidget*const grid_texture=new QWidget();
   tab_texture->layout()->addWidget(grid_texture);
   QGridLayout* grid_layout=new QGridLayout();
@@ -111,6 +257,30 @@ ControlSave::ControlSave(FracplanetMain* save_target,ParametersSave* param)
       this,SLOT(setTextureHeight(int))
       );
 
+  grid_layout->addWidget(new QLabel("Tile size",grid_texture),1,0);
+  QSpinBox* texture_tile_size_spinbox=new QSpinBox();
+  grid_layout->addWidget(texture_tile_size_spinbox,1,1);
+  texture_tile_size_spinbox->setMinimum(2);
+  texture_tile_size_spinbox->setMaximum(65536);
+  texture_tile_size_spinbox->setValue(parameters->texture_tile_size);
+  texture_tile_size_spinbox->setToolTip("Width and height in pixels of each tile of a tiled texture (rounded up to an even number)");
+  connect(
+      texture_tile_size_spinbox,SIGNAL(valueChanged(int)),
+      this,SLOT(setTextureTileSize(int))
+      );
+
+  grid_layout->addWidget(new QLabel("PNG compression",grid_texture),2,0);
+  QSpinBox* texture_png_compression_spinbox=new QSpinBox();
+  grid_layout->addWidget(texture_png_compression_spinbox,2,1);
+  texture_png_compression_spinbox->setMinimum(0);
+  texture_png_compression_spinbox->setMaximum(9);
+  texture_png_compression_spinbox->setValue(parameters->texture_png_compression);
+  texture_png_compression_spinbox->setToolTip("Compression level for PNG textures, from 0 (none, fastest) to 9 (smallest, slowest)");
+  connect(
+      texture_png_compression_spinbox,SIGNAL(valueChanged(int)),
+      this,SLOT(setTexturePNGCompression(int))
+      );
+
   QPushButton*const save_texture=new QPushButton("Save as texture");
   tab_texture->layout()->addWidget(save_texture);
   save_texture->setToolTip("Press to save object as textures");
@@ -118,6 +288,63 @@ ControlSave::ControlSave(FracplanetMain* save_target,ParametersSave* param)
       save_texture,SIGNAL(clicked()),
       save_target,SLOT(save_texture())
       );
+
+  QWidget*const tab_all=new QWidget();
+  tabs->addTab(tab_all,"All");
+  tab_all->setLayout(new QVBoxLayout());
+
+  QCheckBox*const all_pov=new QCheckBox("POV-Ray");
+  tab_all->layout()->addWidget(all_pov);
+  all_pov->setChecked(parameters->all_pov);
+  all_pov->setToolTip("Check to include POV-Ray .pov and .inc files (with the options on its tab)");
+  connect(
+      all_pov,SIGNAL(stateChanged(int)),
+      this,SLOT(setAllPov(int))
+      );
+
+  QCheckBox*const all_blender=new QCheckBox("Blender");
+  tab_all->layout()->addWidget(all_blender);
+  all_blender->setChecked(parameters->all_blender);
+  all_blender->setToolTip("Check to include a Blender script and its mesh data (with the options on its tab)");
+  connect(
+      all_blender,SIGNAL(stateChanged(int)),
+      this,SLOT(setAllBlender(int))
+      );
+
+  QCheckBox*const all_gltf=new QCheckBox("glTF");
+  tab_all->layout()->addWidget(all_gltf);
+  all_gltf->setChecked(parameters->all_gltf);
+  all_gltf->setToolTip("Check to include a binary glTF (.glb) file (with the options on its tab)");
+  connect(
+      all_gltf,SIGNAL(stateChanged(int)),
+      this,SLOT(setAllGltf(int))
+      );
+
+  QCheckBox*const all_mesh=new QCheckBox("PLY/OBJ");
+  tab_all->layout()->addWidget(all_mesh);
+  all_mesh->setChecked(parameters->all_mesh);
+  all_mesh->setToolTip("Check to include PLY or OBJ mesh files (with the options on its tab)");
+  connect(
+      all_mesh,SIGNAL(stateChanged(int)),
+      this,SLOT(setAllMesh(int))
+      );
+
+  QCheckBox*const all_texture=new QCheckBox("Texture");
+  tab_all->layout()->addWidget(all_texture);
+  all_texture->setChecked(parameters->all_texture);
+  all_texture->setToolTip("Check to include textures (with the options on its tab)");
+  connect(
+      all_texture,SIGNAL(stateChanged(int)),
+      this,SLOT(setAllTexture(int))
+      );
+
+  QPushButton*const save_all=new QPushButton("Save selected formats");
+  tab_all->layout()->addWidget(save_all);
+  save_all->setToolTip("Press to save object in all the selected formats at once\n(written concurrently, to files sharing one base filename)");
+  connect(
+      save_all,SIGNAL(clicked()),
+      save_target,SLOT(save_all())
+      );
 }
 
 ControlSave::~ControlSave()
@@ -133,11 +360,46 @@ void ControlSave::setSeaSphere(int v)
   parameters->pov_sea_object=(v==2);
 }
 
+void ControlSave::setPovPalette(int v)
+{
+  parameters->pov_palette=(v==2);
+}
+
+void ControlSave::setPovPaletteBits(int v)
+{
+  parameters->pov_palette_bits=v;
+}
+
 void ControlSave::setPerVertexAlpha(int v)
 {
   parameters->blender_per_vertex_alpha=(v==2);
 }
 
+void ControlSave::setGltfQuantise(int v)
+{
+  parameters->gltf_quantise=(v==2);
+}
+
+void ControlSave::setMeshObj(int v)
+{
+  parameters->mesh_obj=(v==2);
+}
+
+void ControlSave::setDecimate(int v)
+{
+  parameters->decimate=(v==2);
+}
+
+void ControlSave::setDecimateTriangles(int v)
+{
+  parameters->decimate_triangles=v;
+}
+
+void ControlSave::setDecimateError(int v)
+{
+  parameters->decimate_error=v/10000.0f;
+}
+
 void ControlSave::setTextureShaded(int v)
 {
   parameters->texture_shaded=(v==2);
@@ -148,3 +410,57 @@ void ControlSave::setTextureHeight(int v)
   parameters->texture_height=v;
 }
 
+void ControlSave::setTexturePNG(int v)
+{
+  parameters->texture_png=(v==2);
+}
+
+void ControlSave::setTexturePNGCompression(int v)
+{
+  parameters->texture_png_compression=v;
+}
+
+void ControlSave::setTextureDemMesh(int v)
+{
+  parameters->texture_dem_mesh=(v==2);
+}
+
+void ControlSave::setTextureCubeMap(int v)
+{
+  parameters->texture_cube_map=(v==2);
+}
+
+void ControlSave::setTextureTiled(int v)
+{
+  parameters->texture_tiled=(v==2);
+}
+
+void ControlSave::setTextureTileSize(int v)
+{
+  parameters->texture_tile_size=v+v%2;
+}
+
+void ControlSave::setAllPov(int v)
+{
+  parameters->all_pov=(v==2);
+}
+
+void ControlSave::setAllBlender(int v)
+{
+  parameters->all_blender=(v==2);
+}
+
+void ControlSave::setAllGltf(int v)
+{
+  parameters->all_gltf=(v==2);
+}
+
+void ControlSave::setAllMesh(int v)
+{
+  parameters->all_mesh=(v==2);
+}
+
+void ControlSave::setAllTexture(int v)
+{
+  parameters->all_texture=(v==2);
+}
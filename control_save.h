@@ -45,9 +45,27 @@ class ControlSave : public Control
 
   void setAtmosphere(int v);
   void setSeaSphere(int v);
+  void setPovPalette(int v);
+  void setPovPaletteBits(int v);
   void setPerVertexAlpha(int v);
+  void setGltfQuantise(int v);
+  void setMeshObj(int v);
+  void setDecimate(int v);
+  void setDecimateTriangles(int v);
+  void setDecimateError(int v);
   void setTextureShaded(int v);
   void setTextureHeight(int v);
+  void setTexturePNG(int v);
+  void setTexturePNGCompression(int v);
+  void setTextureDemMesh(int v);
+  void setTextureCubeMap(int v);
+  void setTextureTiled(int v);
+  void setTextureTileSize(int v);
+  void setAllPov(int v);
+  void setAllBlender(int v);
+  void setAllGltf(int v);
+  void setAllMesh(int v);
+  void setAllTexture(int v);
 
  private:
 
@@ -149,6 +149,15 @@ ControlTerrain::ControlTerrain(FracplanetMain* tgt,ParametersTerrain* param_terr
       );
   variation_horizontal_spinbox->setToolTip("The magnitude of random horizontal perturbations");
 
+  QCheckBox*const simplify_oceans_checkbox=new QCheckBox("Simplify oceans");
+  grid_terrain_subdivision->addWidget(simplify_oceans_checkbox,4,0,1,2);
+  simplify_oceans_checkbox->setChecked(parameters_terrain->simplify_oceans);
+  connect(
+      simplify_oceans_checkbox,SIGNAL(toggled(bool)),
+      this,SLOT(setSimplifyOceans(bool))
+      );
+  simplify_oceans_checkbox->setToolTip("Merge the flat ocean surface back into larger triangles once sea level has been imposed.\nGreatly reduces the triangle count of ocean-heavy terrain.");
+
   noise_terms_label=new QLabel("Noise terms");
   grid_terrain_noise->addWidget(noise_terms_label,0,0);
   noise_terms_spinbox=new SpinBox(0,10,1);
@@ -78,6 +78,10 @@ class ControlTerrain : public Control
       parameters_terrain->variation.x=v/100.0;
       parameters_terrain->variation.y=v/100.0;
     }
+  void setSimplifyOceans(bool f)
+    {
+      parameters_terrain->simplify_oceans=f;
+    }
   void setNoiseTerms(int v)
     {
       parameters_terrain->noise.terms=v;
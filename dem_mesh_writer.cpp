@@ -0,0 +1,149 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Implementation of class DemMeshWriter.
+*/
+
+#include "precompiled.h"
+
+#include "dem_mesh_writer.h"
+
+#include "little_endian.h"
+#include "text_format.h"
+
+namespace
+{
+  //! Size of a PLY DEM mesh, allowing for its header (OBJ sizes aren't known in advance).
+  unsigned long long expected_size(uint width,uint height,bool obj)
+  {
+    const unsigned long long squares=static_cast<unsigned long long>(width>1 ? width-1 : 0)*(height>1 ? height-1 : 0);
+    return (obj ? 0 : 512+12ULL*width*height+2*13*squares);
+  }
+}
+
+DemMeshWriter::DemMeshWriter(const std::string& filename,uint width,uint height,bool obj)
+  :_out(filename,expected_size(width,height,obj))
+  ,_width(width)
+  ,_height(height)
+  ,_obj(obj)
+  ,_rows(0)
+{
+  const uint triangles=2*(width>1 ? width-1 : 0)*(height>1 ? height-1 : 0);
+  if (_obj)
+    {
+      _out << "# Fracplanet DEM " << width << "x" << height << "\n";
+    }
+  else
+    {
+      _out
+        << "ply\n"
+        << "format binary_little_endian 1.0\n"
+        << "comment Fracplanet DEM " << width << "x" << height << "\n"
+        << "element vertex " << width*height << "\n"
+        << "property float x\n"
+        << "property float y\n"
+        << "property float z\n"
+        << "element face " << triangles << "\n"
+        << "property list uchar uint vertex_indices\n"
+        << "end_header\n";
+    }
+}
+
+DemMeshWriter::~DemMeshWriter()
+{}
+
+void DemMeshWriter::format_vertices(const Raster<ushort>& band,uint first,std::string& s,uint begin,uint end) const
+{
+  const float scale=1.0f/std::max(1u,_height-1);
+  for (uint i=begin;i<end;i++)
+    {
+      const uint row=i/_width;
+      const uint column=i%_width;
+      const float x=column*scale;
+      const float y=1.0f-(first+row)*scale;
+      const float z=band.row(row)[column]/65535.0f;
+      if (_obj)
+        {
+          s+="v ";
+          append_number(s,x);
+          s+=' ';
+          append_number(s,y);
+          s+=' ';
+          append_number(s,z);
+          s+='\n';
+        }
+      else
+        {
+          append_little_endian(s,x);
+          append_little_endian(s,y);
+          append_little_endian(s,z);
+        }
+    }
+}
+
+bool DemMeshWriter::write(const Raster<ushort>& band)
+{
+  assert(band.width()==_width);
+  assert(_rows+band.height()<=_height);
+  write_formatted(_out,_width*band.height(),boost::bind(&DemMeshWriter::format_vertices,this,boost::cref(band),_rows,_1,_2,_3),0,0,1);
+  _rows+=band.height();
+  return _out;
+}
+
+/*! Triangles 2i and 2i+1 split the square whose top left pixel is the i-th of the (width-1)*(height-1) such pixels,
+  both anticlockwise seen from above.
+ */
+void DemMeshWriter::format_triangles(std::string& s,uint begin,uint end) const
+{
+  for (uint t=begin;t<end;t++)
+    {
+      const uint square=t/2;
+      const uint v00=(square/(_width-1))*_width+square%(_width-1);
+      const uint v01=v00+1;
+      const uint v10=v00+_width;
+      const uint v11=v10+1;
+      const uint v[3]={(t%2 ? v01 : v00),v10,(t%2 ? v11 : v01)};
+      if (_obj)
+        {
+          s+='f';
+          for (uint i=0;i<3;i++)
+            {
+              // OBJ indices count from 1
+              s+=' ';
+              append_number(s,v[i]+1);
+            }
+          s+='\n';
+        }
+      else
+        {
+          s+=static_cast<char>(3);
+          for (uint i=0;i<3;i++)
+            append_little_endian(s,v[i]);
+        }
+    }
+}
+
+bool DemMeshWriter::close()
+{
+  if (_width>1 && _height>1)
+    write_formatted(_out,2*(_width-1)*(_height-1),boost::bind(&DemMeshWriter::format_triangles,this,_1,_2,_3),0,0,1);
+  _out.close();
+  return (_out && _rows==_height);
+}
@@ -0,0 +1,73 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Interface for class DemMeshWriter.
+*/
+
+#ifndef _dem_mesh_writer_h_
+#define _dem_mesh_writer_h_
+
+#include "async_ofstream.h"
+#include "image.h"
+
+//! Writes a DEM, a band of rows at a time (as RasterWriter does), as a grid mesh file: binary PLY or OBJ.
+/*! There's a vertex for each pixel and two triangles for each square of four neighbouring pixels.
+  Pixel (column,row) is at x=column/(height-1), y=1-row/(height-1) (so x spans the image's aspect ratio),
+  and its value gives z from 0.0 to 1.0 (the DEM's 0 to 65535).
+  Vertices are written as their rows arrive; the triangles, which only depend on the grid size, are written by close().
+ */
+class DemMeshWriter : public boost::noncopyable
+{
+ public:
+
+  //! Constructor.  Opens the file and (for PLY) writes the header.
+  DemMeshWriter(const std::string& filename,uint width,uint height,bool obj);
+
+  //! Destructor.
+  ~DemMeshWriter();
+
+  //! Append the vertices for the rows of a band (which must be the full width of the DEM).
+  bool write(const Raster<ushort>& band);
+
+  //! Write the triangles and finish the file.  Returns false if there were any errors, or not all rows were written.
+  bool close();
+
+ private:
+
+  //! Append the vertices for pixels [begin,end) of a band, whose first row is row first, to s.
+  void format_vertices(const Raster<ushort>& band,uint first,std::string& s,uint begin,uint end) const;
+
+  //! Append triangles [begin,end) to s.
+  void format_triangles(std::string& s,uint begin,uint end) const;
+
+  AsyncOfstream _out;
+
+  const uint _width;
+
+  const uint _height;
+
+  //! Whether to write OBJ, rather than PLY.
+  const bool _obj;
+
+  //! Number of rows written so far.
+  uint _rows;
+};
+
+#endif
@@ -30,6 +30,7 @@
 
 #include "precompiled.h"
 
+#include "async_ofstream.h"
 #include "fracplanet_main.h"
 
 //! Application code
@@ -49,6 +50,7 @@ int main(int argc,char* argv[])
       opt_desc.add_options()
     ("help,h","show list of recognised options")
     ("verbose,v","verbose output to stderr")
+    ("direct-io","write large exported files bypassing the page cache (O_DIRECT)")
     ;
 
       opt_desc.add(ParametersRender::options());
@@ -75,6 +77,8 @@ int main(int argc,char* argv[])
 
   const bool verbose=opts.count("verbose");
 
+  AsyncFileBuf::set_direct(opts.count("direct-io"));
+
   if (verbose)
     std::cerr << "Setting up...\n";
 
@@ -8,7 +8,7 @@ PRECOMPILED_HEADER = precompiled.h
 
 HEADERS += $$system(ls *.h)
 SOURCES += $$system(ls *.cpp)
-LIBS += -lboost_program_options-mt -lGLU
+LIBS += -lboost_program_options-mt -lboost_thread-mt -lboost_system-mt -lGLU -lz
 
 DEFINES += QT_DLL
 
@@ -21,7 +21,12 @@
 
 #include "fracplanet_main.h"
 
+#include "async_ofstream.h"
+#include "concurrent_export.h"
+#include "dem_mesh_writer.h"
+#include "gltf_writer.h"
 #include "image.h"
+#include "tile_pyramid.h"
 
 FracplanetMain::FracplanetMain(QWidget* parent,QApplication* app,const boost::program_options::variables_map& opts,bool verbose)
   :QWidget(parent)
@@ -35,6 +40,7 @@ FracplanetMain::FracplanetMain(QWidget* parent,QApplication* app,const boost::pr
   ,parameters_save(&parameters_render)
   ,last_step(0)
   ,progress_was_stalled(false)
+  ,concurrent_export(0)
 {
   setLayout(new QVBoxLayout);
 
@@ -59,6 +65,12 @@ FracplanetMain::~FracplanetMain()
 
 void FracplanetMain::progress_start(uint target,const std::string& info)
 {
+  if (concurrent_export && concurrent_export->in_job_thread())
+    {
+      concurrent_export->progress_start(target,info);
+      return;
+    }
+
   if (!progress_dialog.get())
     {
       progress_dialog=std::auto_ptr<QProgressDialog>(new QProgressDialog("Progress","Cancel",0,100,this));
@@ -85,6 +97,12 @@ void FracplanetMain::progress_start(uint target,const std::string& info)
 
 void FracplanetMain::progress_stall(const std::string& reason)
 {
+  if (concurrent_export && concurrent_export->in_job_thread())
+    {
+      concurrent_export->progress_stall(reason);
+      return;
+    }
+
   progress_was_stalled=true;
   progress_dialog->setLabelText(reason.c_str());
   application->processEvents();
@@ -92,6 +110,12 @@ void FracplanetMain::progress_stall(const std::string& reason)
 
 void FracplanetMain::progress_step(uint step)
 {
+  if (concurrent_export && concurrent_export->in_job_thread())
+    {
+      concurrent_export->progress_step(step);
+      return;
+    }
+
   if (progress_was_stalled)
     {
       progress_dialog->setLabelText(progress_info.c_str());
@@ -114,6 +138,12 @@ void FracplanetMain::progress_step(uint step)
 
 void FracplanetMain::progress_complete(const std::string& info)
 {
+  if (concurrent_export && concurrent_export->in_job_thread())
+    {
+      concurrent_export->progress_complete(info);
+      return;
+    }
+
   progress_dialog->setLabelText(info.c_str());
 
   last_step=static_cast<uint>(-1);
@@ -244,11 +274,27 @@ void FracplanetMain::save_pov()
       viewer->hide();
 
       const std::string filename_base(selected_filename.left(selected_filename.length()-4).toLocal8Bit());
-      const std::string filename_pov=filename_base+".pov";
-      const std::string filename_inc=filename_base+".inc";
+      const bool ok=export_pov(filename_base);
+
+      progress_dialog.reset(0);
+
+      viewer->showNormal();
+      viewer->raise();
+
+      if (!ok)
+    {
+      QMessageBox::critical(this,"Fracplanet","Errors ocurred while the files were being written.");
+    }
+    }
+}
 
-      const size_t last_separator=filename_inc.rfind('/');
-      const std::string filename_inc_relative_to_pov=
+bool FracplanetMain::export_pov(const std::string& filename_base)
+{
+  const std::string filename_pov=filename_base+".pov";
+  const std::string filename_inc=filename_base+".inc";
+
+  const size_t last_separator=filename_inc.rfind('/');
+  const std::string filename_inc_relative_to_pov=
     "./"
     +(
       last_separator==std::string::npos
@@ -258,32 +304,21 @@ void FracplanetMain::save_pov()
       filename_inc.substr(last_separator+1)
       );
 
-      std::ofstream out_pov(filename_pov.c_str());
-      std::ofstream out_inc(filename_inc.c_str());
-
-      // Boilerplate for renderer
-      out_pov << "camera {perspective location <0,1,-4.5> look_at <0,0,0> angle 45}\n";
-      out_pov << "light_source {<100,100,-100> color rgb <1.0,1.0,1.0>}\n";
-      out_pov << "#include \""+filename_inc_relative_to_pov+"\"\n";
+  AsyncOfstream out_pov(filename_pov);
+  AsyncOfstream out_inc(filename_inc);
 
-      mesh_terrain->write_povray(out_inc,parameters_save,parameters_terrain);
-      if (mesh_cloud) mesh_cloud->write_povray(out_inc,parameters_save,parameters_cloud);
+  // Boilerplate for renderer
+  out_pov << "camera {perspective location <0,1,-4.5> look_at <0,0,0> angle 45}\n";
+  out_pov << "light_source {<100,100,-100> color rgb <1.0,1.0,1.0>}\n";
+  out_pov << "#include \""+filename_inc_relative_to_pov+"\"\n";
 
-      out_pov.close();
-      out_inc.close();
-
-      const bool ok=(out_pov && out_inc);
-
-      progress_dialog.reset(0);
+  mesh_terrain->write_povray(out_inc,parameters_save,parameters_terrain);
+  if (mesh_cloud) mesh_cloud->write_povray(out_inc,parameters_save,parameters_cloud);
 
-      viewer->showNormal();
-      viewer->raise();
+  out_pov.close();
+  out_inc.close();
 
-      if (!ok)
-    {
-      QMessageBox::critical(this,"Fracplanet","Errors ocurred while the files were being written.");
-    }
-    }
+  return (out_pov && out_inc);
 }
 
 void FracplanetMain::save_blender()
@@ -304,144 +339,383 @@ void FracplanetMain::save_blender()
         viewer->hide();
 
         const std::string filename(selected_filename.toLocal8Bit());
-        std::ofstream out(filename.c_str());
-
-        // Boilerplate
-        out <<
-            "#+\n"
-            "# Instructions for loading this model into Blender:\n"
-            "#\n"
-            "# Open a new Blender document. Get rid of the default cube, and any other\n"
-            "# extraneous stuff you don't want. Bring up a Text Editor window.\n"
-            "# Click the Open button. Select this .py file to load it into\n"
-            "# a new text block. Execute the text block with ALT-P. The recreated model\n"
-            "# should now be visible in the 3D view. You can now delete the text.\n"
-            "# block containing this script from the document. Save the document.\n"
-            "#-\n"
-            "\n";
-        out <<
-            "import bpy\n"
-            "import bmesh\n"
-            "from mathutils import \\\n"
-            "    Color\n"
-            "\n"
-            "bpy.ops.object.add(type = \"MESH\")\n"
-            "the_mesh_obj = bpy.context.active_object\n"
-            "the_mesh_obj.name = \"fracplanet\"\n"
-            "the_mesh = the_mesh_obj.data\n"
-            "the_mesh.name = \"fracplanet\"\n"
-            "the_bmesh = bmesh.new()\n"
-            "color_layer = the_bmesh.loops.layers.color.new(\"Col\") # same name as used by Blender\n"
-            "\n"
-            "def v(x, y, z) :\n"
-            "  # adds a new vertex to the mesh.\n"
-            "    the_bmesh.verts.new((x, y, z))\n"
-            "#end v\n"
-            "\n";
-        out <<
-          "def f(material, v0, v1, v2, c0, c1, c2) :\n"
-          "  # adds a new face and associated vertex colours to the mesh.\n"
-          "    the_bmesh.verts.index_update()\n"
-          "    tface = the_bmesh.faces.new((the_bmesh.verts[v0], the_bmesh.verts[v1], the_bmesh.verts[v2]))\n"
-          "    tface.smooth = True\n"
-          "    tface.material_index = material\n"
-          "    colors = {v0 : Color(tuple(c / 255 for c in c0[:3])), v1 : Color(tuple(c / 255 for c in c1[:3])), v2 : Color(tuple(c / 255 for c in c2[:3]))}\n"
-                 /* unfortunately, I can't do anything with alpha */
-          "    for l in tface.loops :\n"
-          "        l[color_layer] = colors[l.vert.index]\n"
-          "    #end for\n"
-          "#end f\n\n";
-
-        mesh_terrain->write_blender(out,parameters_save,parameters_terrain,"fracplanet");
-        if (mesh_cloud) mesh_cloud->write_blender(out,parameters_save,parameters_cloud,"fracplanet");
-
-        out <<
-            "the_bmesh.normal_update()\n"
-            "the_bmesh.to_mesh(the_mesh)\n"
-            "the_mesh.update()\n"
-            "bpy.context.scene.update()\n";
-
-        out.close();
+        const std::string filename_base
+          (
+           selected_filename.toUpper().endsWith(".PY")
+           ?
+           selected_filename.left(selected_filename.length()-3).toLocal8Bit()
+           :
+           filename
+           );
+        const bool ok=export_blender(filename,filename_base);
 
         progress_dialog.reset(0);
 
         viewer->showNormal();
         viewer->raise();
 
-        if (!out)
+        if (!ok)
       {
         QMessageBox::critical(this,"Fracplanet","Errors ocurred while the files were being written.");
       }
       }
   } /*FracplanetMain::save_blender*/
 
-void FracplanetMain::save_texture()
+bool FracplanetMain::export_blender(const std::string& filename,const std::string& filename_base)
 {
-  const uint height=parameters_save.texture_height;
-  const uint width=height*mesh_terrain->geometry().scan_convert_image_aspect_ratio();
+  AsyncOfstream out(filename);
+
+  // Boilerplate
+  out <<
+      "#+\n"
+      "# Instructions for loading this model into Blender (3.2 or later, for colour attributes):\n"
+      "#\n"
+      "# Run blender with this script as its -P argument, or open it in a Text Editor\n"
+      "# window and execute it with ALT-P. The mesh data is loaded from the _terrain.bin\n"
+      "# (and any _cloud.bin) file saved with it; these are looked for where they\n"
+      "# were saved, then next to this script. Save the document once it's loaded.\n"
+      "#-\n"
+      "\n";
+  out <<
+      "import bpy\n"
+      "import numpy\n"
+      "import os\n"
+      "\n"
+      "def material(name, colour) :\n"
+      "  # a material taking its base colour from the Col vertex colours.\n"
+      "    mat = bpy.data.materials.new(name)\n"
+      "    mat.diffuse_color = colour\n"
+      "    mat.use_nodes = True\n"
+      "    nodes = mat.node_tree.nodes\n"
+      "    attribute = nodes.new(\"ShaderNodeAttribute\")\n"
+      "    attribute.attribute_name = \"Col\"\n"
+      "    mat.node_tree.links.new(attribute.outputs[\"Color\"], nodes[\"Principled BSDF\"].inputs[\"Base Color\"])\n"
+      "    return mat\n"
+      "#end material\n"
+      "\n"
+      "def load(name, filename, vertices, triangles, triangles_of_colour0, byte_order) :\n"
+      "  # adds an object for a mesh saved by fracplanet: vertex positions, then vertex indices\n"
+      "  # and colours (bytes) for each triangle corner.\n"
+      "    if not os.path.exists(filename) :\n"
+      "        filename = os.path.join(os.path.dirname(os.path.abspath(__file__)), os.path.basename(filename))\n"
+      "    #end if\n"
+      "    data = numpy.fromfile(filename, dtype = numpy.uint8)\n"
+      "    positions = data[: 12 * vertices].view(byte_order + \"f4\").astype(numpy.float32)\n"
+      "    indices = data[12 * vertices : 12 * (vertices + triangles)].view(byte_order + \"u4\").astype(numpy.int32)\n"
+      "    colours = data[12 * (vertices + triangles) :].astype(numpy.float32) / 255.0\n"
+      "    the_mesh = bpy.data.meshes.new(name)\n"
+      "    the_mesh.vertices.add(vertices)\n"
+      "    the_mesh.vertices.foreach_set(\"co\", positions)\n"
+      "    the_mesh.loops.add(3 * triangles)\n"
+      "    the_mesh.loops.foreach_set(\"vertex_index\", indices)\n"
+      "    the_mesh.polygons.add(triangles)\n"
+      "    the_mesh.polygons.foreach_set(\"loop_start\", numpy.arange(0, 3 * triangles, 3, dtype = numpy.int32))\n"
+      "    if not bpy.types.MeshPolygon.bl_rna.properties[\"loop_total\"].is_readonly :\n"
+      "        the_mesh.polygons.foreach_set(\"loop_total\", numpy.full(triangles, 3, dtype = numpy.int32))\n"
+      "    #end if\n"
+      "    material_index = numpy.zeros(triangles, dtype = numpy.int32)\n"
+      "    material_index[triangles_of_colour0 :] = 1\n"
+      "    the_mesh.polygons.foreach_set(\"material_index\", material_index)\n"
+      "    the_mesh.polygons.foreach_set(\"use_smooth\", numpy.ones(triangles, dtype = bool))\n"
+      "    the_mesh.update(calc_edges = True)\n"
+      "    color_layer = the_mesh.color_attributes.new(\"Col\", \"BYTE_COLOR\", \"CORNER\") # same name as used by Blender\n"
+      "    srgb = \"color_srgb\" in bpy.types.ByteColorAttributeValue.bl_rna.properties\n"
+      "    color_layer.data.foreach_set((\"color_srgb\" if srgb else \"color\"), colours)\n"
+      "    the_mesh.materials.append(material(name + \"0\", (0.0, 1.0, 0.0, 1.0)))\n"
+      "    the_mesh.materials.append(material(name + \"1\", (0.0, 0.0, 1.0, 1.0)))\n"
+      "    the_mesh_obj = bpy.data.objects.new(name, the_mesh)\n"
+      "    bpy.context.collection.objects.link(the_mesh_obj)\n"
+      "#end load\n"
+      "\n";
+
+  mesh_terrain->write_blender(out,filename_base,parameters_save,parameters_terrain,"fracplanet");
+  if (mesh_cloud) mesh_cloud->write_blender(out,filename_base,parameters_save,parameters_cloud,"fracplanet");
+
+  out.close();
+
+  return !out.fail();
+}
 
+void FracplanetMain::save_gltf()
+{
   const QString selected_filename=QFileDialog::getSaveFileName
     (
      this,
-     "Texture",
+     "glTF",
      ".",
-     "(*.ppm)"
+     "(*.glb)"
      );
   if (selected_filename.isEmpty())
     {
       QMessageBox::critical(this,"Fracplanet","No file specified\nNothing saved");
     }
-  else if (!(selected_filename.toUpper().endsWith(".PPM")))
+  else if (!selected_filename.toUpper().endsWith(".GLB"))
     {
-      QMessageBox::critical(this,"Fracplanet","File selected must have .ppm suffix.");
+      QMessageBox::critical(this,"Fracplanet","File selected must have .glb suffix.");
     }
   else
     {
+      viewer->hide();
+
       const std::string filename(selected_filename.toLocal8Bit());
-      const std::string filename_base(selected_filename.left(selected_filename.length()-4).toLocal8Bit());
+      const bool ok=export_gltf(filename);
 
+      progress_dialog.reset(0);
+
+      viewer->showNormal();
+      viewer->raise();
+
+      if (!ok)
+    {
+      QMessageBox::critical(this,"Fracplanet","Errors ocurred while the file was being written.");
+    }
+    }
+}
+
+bool FracplanetMain::export_gltf(const std::string& filename)
+{
+  GltfWriter gltf(parameters_save.gltf_quantise,this);
+  mesh_terrain->write_gltf(gltf,parameters_save,"fracplanet");
+  if (mesh_cloud) mesh_cloud->write_gltf(gltf,"fracplanet");
+  return gltf.write(filename);
+}
+
+void FracplanetMain::save_mesh()
+{
+  const QString suffix(parameters_save.mesh_obj ? ".obj" : ".ply");
+
+  const QString selected_filename=QFileDialog::getSaveFileName
+    (
+     this,
+     "PLY/OBJ",
+     ".",
+     "(*"+suffix+")"
+     );
+  if (selected_filename.isEmpty())
+    {
+      QMessageBox::critical(this,"Fracplanet","No file specified\nNothing saved");
+    }
+  else if (!(selected_filename.toUpper().endsWith(suffix.toUpper())))
+    {
+      QMessageBox::critical(this,"Fracplanet","File selected must have "+suffix+" suffix.");
+    }
+  else
+    {
       viewer->hide();
 
-      bool ok=true;
-      {
-    boost::scoped_ptr<Image<ByteRGBA> > terrain_image(new Image<ByteRGBA>(width,height));
-    terrain_image->fill(ByteRGBA(0,0,0,0));
-    boost::scoped_ptr<Image<ushort> > terrain_dem(new Image<ushort>(width,height));
-    terrain_dem->fill(0);
+      const std::string filename_base(selected_filename.left(selected_filename.length()-4).toLocal8Bit());
+      const bool ok=export_mesh(filename_base);
+
+      progress_dialog.reset(0);
 
-    boost::scoped_ptr<Image<ByteRGBA> > terrain_normals(new Image<ByteRGBA>(width,height));
-    terrain_normals->fill(ByteRGBA(128,128,128,0));
+      viewer->showNormal();
+      viewer->raise();
 
-    mesh_terrain->render_texture
+      if (!ok)
+    {
+      QMessageBox::critical(this,"Fracplanet","Errors ocurred while the files were being written.");
+    }
+    }
+}
+
+bool FracplanetMain::export_mesh(const std::string& filename_base)
+{
+  const std::string suffix(parameters_save.mesh_obj ? ".obj" : ".ply");
+
+  AsyncOfstream out(filename_base+suffix);
+  mesh_terrain->write_mesh(out,parameters_save,"fracplanet");
+  out.close();
+  bool ok=!out.fail();
+
+  if (mesh_cloud)
+    {
+      AsyncOfstream out_cloud(filename_base+"_cloud"+suffix);
+      mesh_cloud->write_mesh(out_cloud,parameters_save,"fracplanet");
+      out_cloud.close();
+      if (!out_cloud) ok=false;
+    }
+
+  return ok;
+}
+
+namespace
+{
+  //! Append a band of rendered texture, DEM, normal map and (if there is one) cloud to their writers.
+  /*! The writers are RasterWriters or TilePyramidWriters.
+   */
+  template <class I,class D,class N,class C> bool write_texture_band
+  (
+   I& image,
+   D& dem,
+   N& normals,
+   C* cloud,
+   const Raster<ByteRGBA>& band_image,
+   const Raster<ushort>* band_dem,
+   const Raster<ByteRGBA>* band_normals,
+   const Raster<uchar>* band_cloud
+   )
+  {
+    return
+      image.write(band_image)
+      && dem.write(*band_dem)
+      && normals.write(*band_normals)
+      && (!cloud || cloud->write(*band_cloud));
+  }
+
+  //! Writes DEM bands to a DEM writer (a RasterWriter or TilePyramidWriter) and also, if there is one, a DemMeshWriter.
+  template <class D> class DemWriters
+  {
+  public:
+
+    DemWriters(D& dem,DemMeshWriter* dem_mesh)
+      :_dem(dem)
+      ,_dem_mesh(dem_mesh)
+    {}
+
+    bool write(const Raster<ushort>& band)
+    {
+      return _dem.write(band) && (!_dem_mesh || _dem_mesh->write(band));
+    }
+
+    bool close()
+    {
+      const bool ok=_dem.close();
+      return (!_dem_mesh || _dem_mesh->close()) && ok;
+    }
+
+  private:
+
+    D& _dem;
+
+    DemMeshWriter*const _dem_mesh;
+  };
+
+  //! Render the terrain's texture, DEM and normal map (and any cloud layer's alpha, in the same pass) to the writers, then close them.
+  template <class I,class D,class N,class C> bool write_texture
+  (
+   const TriangleMeshTerrain& terrain,
+   const TriangleMesh* cloud_mesh,
+   const ParametersSave& parameters_save,
+   const ParametersRender& parameters_render,
+   uint width,
+   uint height,
+   I& image,
+   D& dem,
+   N& normals,
+   C* cloud
+   )
+  {
+    // Render and write a band of rows at a time, so memory use doesn't grow with the texture size.
+    // Bands of about 4 megapixels (40MByte for the three images) are still tall enough to render in parallel.
+    const uint band_height=std::max(1u,(1u<<22)/width);
+
+    bool ok=terrain.render_texture_bands
       (
-       *terrain_image,
-       terrain_dem.get(),
-       terrain_normals.get(),
+       width,
+       height,
+       band_height,
+       true,
+       true,
+       cloud_mesh,
        parameters_save.texture_shaded,
        parameters_render.ambient,
-       parameters_render.illumination_direction()
+       parameters_render.illumination_direction(),
+       boost::bind(&write_texture_band<I,D,N,C>,boost::ref(image),boost::ref(dem),boost::ref(normals),cloud,_1,_2,_3,_4)
        );
 
-    if (!terrain_image->write_ppmfile(filename,this)) ok=false;
+    if (!image.close()) ok=false;
+    if (!dem.close()) ok=false;
+    if (!normals.close()) ok=false;
+    if (cloud && !cloud->close()) ok=false;
+    return ok;
+  }
+
+  //! Append a band of one face of a cube map to that face's writers.
+  template <class I,class D,class N,class C> bool write_cube_map_band
+  (
+   const std::vector<boost::shared_ptr<I> >& images,
+   const std::vector<boost::shared_ptr<D> >& dems,
+   const std::vector<boost::shared_ptr<N> >& normals,
+   const std::vector<boost::shared_ptr<C> >& clouds,
+   uint face,
+   const Raster<ByteRGBA>& band_image,
+   const Raster<ushort>* band_dem,
+   const Raster<ByteRGBA>* band_normals,
+   const Raster<uchar>* band_cloud
+   )
+  {
+    return write_texture_band(*images[face],*dems[face],*normals[face],(clouds.empty() ? 0 : clouds[face].get()),band_image,band_dem,band_normals,band_cloud);
+  }
+
+  //! As write_texture, but for the six faces of a cube map, each with its own writers (and no cloud writers if there's no cloud layer).
+  template <class I,class D,class N,class C> bool write_cube_map
+  (
+   const TriangleMeshTerrain& terrain,
+   const TriangleMesh* cloud_mesh,
+   const ParametersSave& parameters_save,
+   const ParametersRender& parameters_render,
+   uint size,
+   const std::vector<boost::shared_ptr<I> >& images,
+   const std::vector<boost::shared_ptr<D> >& dems,
+   const std::vector<boost::shared_ptr<N> >& normals,
+   const std::vector<boost::shared_ptr<C> >& clouds
+   )
+  {
+    // Bands are the same rows of all six faces, so about 4 megapixels in all.
+    const uint band_height=std::max(1u,(1u<<22)/(6*size));
 
-    if (ok && terrain_dem)
-      {
-        if (!terrain_dem->write_pgmfile(filename_base+"_dem.pgm",this)) ok=false;
-      }
+    bool ok=terrain.render_cube_map_bands
+      (
+       size,
+       band_height,
+       true,
+       true,
+       cloud_mesh,
+       parameters_save.texture_shaded,
+       parameters_render.ambient,
+       parameters_render.illumination_direction(),
+       boost::bind(&write_cube_map_band<I,D,N,C>,boost::cref(images),boost::cref(dems),boost::cref(normals),boost::cref(clouds),_1,_2,_3,_4,_5)
+       );
 
-    if (ok && terrain_normals)
+    for (uint f=0;f<6;f++)
       {
-        if (!terrain_normals->write_ppmfile(filename_base+"_norm.ppm",this)) ok=false;
-      }
+        if (!images[f]->close()) ok=false;
+        if (!dems[f]->close()) ok=false;
+        if (!normals[f]->close()) ok=false;
+        if (!clouds.empty() && !clouds[f]->close()) ok=false;
       }
+    return ok;
+  }
+}
+
+void FracplanetMain::save_texture()
+{
+  const ImageFormat format(parameters_save.texture_png,parameters_save.texture_png_compression);
+  const QString suffix=QString(".")+format.extension<ByteRGBA>();
 
-      if (ok && mesh_cloud)
+  const QString selected_filename=QFileDialog::getSaveFileName
+    (
+     this,
+     "Texture",
+     ".",
+     "(*"+suffix+")"
+     );
+  if (selected_filename.isEmpty())
+    {
+      QMessageBox::critical(this,"Fracplanet","No file specified\nNothing saved");
+    }
+  else if (!(selected_filename.toUpper().endsWith(suffix.toUpper())))
     {
-      QMessageBox::warning(this,"Fracplanet","Texture save of cloud mesh not currently supported");
-      //boost::scoped_ptr<Image<uchar> > cloud_image(new Image<uchar>(width,height));
-      //mesh_cloud->render_texture(*cloud_image);
-      //if (!cloud_image->write_pgmfile(filename_base+"_cloud.png",this)) ok=false;
+      QMessageBox::critical(this,"Fracplanet","File selected must have "+suffix+" suffix.");
     }
+  else
+    {
+      const std::string filename(selected_filename.toLocal8Bit());
+      const std::string filename_base(selected_filename.left(selected_filename.length()-4).toLocal8Bit());
+
+      viewer->hide();
+
+      const bool ok=export_texture(filename,filename_base);
 
       progress_dialog.reset(0);
 
@@ -454,3 +728,157 @@ void FracplanetMain::save_texture()
     }
     }
 }
+
+bool FracplanetMain::export_texture(const std::string& filename,const std::string& filename_base)
+{
+  const uint height=parameters_save.texture_height;
+  const uint width=height*mesh_terrain->geometry().scan_convert_image_aspect_ratio();
+  const bool cube_map=(parameters_save.texture_cube_map && dynamic_cast<const GeometrySpherical*>(&mesh_terrain->geometry()));
+  const ImageFormat format(parameters_save.texture_png,parameters_save.texture_png_compression);
+
+  // The DEM's grid mesh (only for single, rather than cube map, DEMs).
+  boost::scoped_ptr<DemMeshWriter> dem_mesh
+    (
+     parameters_save.texture_dem_mesh && !cube_map
+     ?
+     new DemMeshWriter(filename_base+"_dem"+(parameters_save.mesh_obj ? ".obj" : ".ply"),width,height,parameters_save.mesh_obj)
+     :
+     0
+     );
+
+  bool ok;
+  if (cube_map)
+    {
+      // Faces have the same resolution at their centres as the equirectangular texture along its equator.
+      const uint size=std::max(1u,static_cast<uint>(2.0*M_1_PI*height+0.5));
+      if (parameters_save.texture_tiled)
+        {
+          const uint tile_size=parameters_save.texture_tile_size;
+          std::vector<boost::shared_ptr<TilePyramidWriter<ByteRGBA> > > terrain_images;
+          std::vector<boost::shared_ptr<TilePyramidWriter<ushort> > > terrain_dems;
+          std::vector<boost::shared_ptr<TilePyramidWriter<ByteRGBA,NormalMean> > > terrain_normals;
+          std::vector<boost::shared_ptr<TilePyramidWriter<uchar> > > cloud_alphas;
+          for (uint f=0;f<6;f++)
+            {
+              const std::string face_base=filename_base+"_"+CubeMapFace::name(f);
+              terrain_images.push_back(boost::shared_ptr<TilePyramidWriter<ByteRGBA> >(new TilePyramidWriter<ByteRGBA>(face_base+"_texture_tiles",size,size,tile_size,ByteRGBA(0,0,0,0),format)));
+              terrain_dems.push_back(boost::shared_ptr<TilePyramidWriter<ushort> >(new TilePyramidWriter<ushort>(face_base+"_dem_tiles",size,size,tile_size,0,format)));
+              terrain_normals.push_back(boost::shared_ptr<TilePyramidWriter<ByteRGBA,NormalMean> >(new TilePyramidWriter<ByteRGBA,NormalMean>(face_base+"_norm_tiles",size,size,tile_size,ByteRGBA(128,128,128,0),format)));
+              if (mesh_cloud) cloud_alphas.push_back(boost::shared_ptr<TilePyramidWriter<uchar> >(new TilePyramidWriter<uchar>(face_base+"_cloud_tiles",size,size,tile_size,0,format)));
+            }
+          ok=write_cube_map(*mesh_terrain,mesh_cloud.get(),parameters_save,parameters_render,size,terrain_images,terrain_dems,terrain_normals,cloud_alphas);
+        }
+      else
+        {
+          std::vector<boost::shared_ptr<RasterWriter<ByteRGBA> > > terrain_images;
+          std::vector<boost::shared_ptr<RasterWriter<ushort> > > terrain_dems;
+          std::vector<boost::shared_ptr<RasterWriter<ByteRGBA> > > terrain_normals;
+          std::vector<boost::shared_ptr<RasterWriter<uchar> > > cloud_alphas;
+          for (uint f=0;f<6;f++)
+            {
+              const std::string face_base=filename_base+"_"+CubeMapFace::name(f);
+              terrain_images.push_back(boost::shared_ptr<RasterWriter<ByteRGBA> >(new RasterWriter<ByteRGBA>(face_base+"."+format.extension<ByteRGBA>(),size,size,format)));
+              terrain_dems.push_back(boost::shared_ptr<RasterWriter<ushort> >(new RasterWriter<ushort>(face_base+"_dem."+format.extension<ushort>(),size,size,format)));
+              terrain_normals.push_back(boost::shared_ptr<RasterWriter<ByteRGBA> >(new RasterWriter<ByteRGBA>(face_base+"_norm."+format.extension<ByteRGBA>(),size,size,format)));
+              if (mesh_cloud) cloud_alphas.push_back(boost::shared_ptr<RasterWriter<uchar> >(new RasterWriter<uchar>(face_base+"_cloud."+format.extension<uchar>(),size,size,format)));
+            }
+          ok=write_cube_map(*mesh_terrain,mesh_cloud.get(),parameters_save,parameters_render,size,terrain_images,terrain_dems,terrain_normals,cloud_alphas);
+        }
+    }
+  else if (parameters_save.texture_tiled)
+    {
+      const uint tile_size=parameters_save.texture_tile_size;
+      TilePyramidWriter<ByteRGBA> terrain_image(filename_base+"_texture_tiles",width,height,tile_size,ByteRGBA(0,0,0,0),format);
+      TilePyramidWriter<ushort> terrain_dem(filename_base+"_dem_tiles",width,height,tile_size,0,format);
+      TilePyramidWriter<ByteRGBA,NormalMean> terrain_normals(filename_base+"_norm_tiles",width,height,tile_size,ByteRGBA(128,128,128,0),format);
+      boost::scoped_ptr<TilePyramidWriter<uchar> > cloud_alpha(mesh_cloud ? new TilePyramidWriter<uchar>(filename_base+"_cloud_tiles",width,height,tile_size,0,format) : 0);
+      DemWriters<TilePyramidWriter<ushort> > terrain_dems(terrain_dem,dem_mesh.get());
+      ok=write_texture(*mesh_terrain,mesh_cloud.get(),parameters_save,parameters_render,width,height,terrain_image,terrain_dems,terrain_normals,cloud_alpha.get());
+    }
+  else
+    {
+      RasterWriter<ByteRGBA> terrain_image(filename,width,height,format);
+      RasterWriter<ushort> terrain_dem(filename_base+"_dem."+format.extension<ushort>(),width,height,format);
+      RasterWriter<ByteRGBA> terrain_normals(filename_base+"_norm."+format.extension<ByteRGBA>(),width,height,format);
+      boost::scoped_ptr<RasterWriter<uchar> > cloud_alpha(mesh_cloud ? new RasterWriter<uchar>(filename_base+"_cloud."+format.extension<uchar>(),width,height,format) : 0);
+      DemWriters<RasterWriter<ushort> > terrain_dems(terrain_dem,dem_mesh.get());
+      ok=write_texture(*mesh_terrain,mesh_cloud.get(),parameters_save,parameters_render,width,height,terrain_image,terrain_dems,terrain_normals,cloud_alpha.get());
+    }
+
+  return ok;
+}
+
+/*! Each format is written by its own thread (which still parallelises its own work as usual)
+  from the same, unchanging, meshes, so the save takes about as long as the slowest format alone.
+  Progress reported by the meshes from those threads is collected by a ConcurrentExport,
+  and this thread displays it until they're all done.
+ */
+void FracplanetMain::save_all()
+{
+  if (!(parameters_save.all_pov || parameters_save.all_blender || parameters_save.all_gltf || parameters_save.all_mesh || parameters_save.all_texture))
+    {
+      QMessageBox::critical(this,"Fracplanet","No formats selected\nNothing saved");
+      return;
+    }
+
+  const QString selected_filename=QFileDialog::getSaveFileName
+    (
+     this,
+     "Base filename",
+     ".",
+     "(*)"
+     );
+  if (selected_filename.isEmpty())
+    {
+      QMessageBox::critical(this,"Fracplanet","No file specified\nNothing saved");
+    }
+  else
+    {
+      // Any suffix given is dropped; each format adds its own.
+      const int dot=selected_filename.lastIndexOf('.');
+      const QString base=(dot>selected_filename.lastIndexOf('/') ? selected_filename.left(dot) : selected_filename);
+      const std::string filename_base(base.toLocal8Bit());
+      const ImageFormat format(parameters_save.texture_png,parameters_save.texture_png_compression);
+
+      viewer->hide();
+
+      ConcurrentExport jobs;
+      if (parameters_save.all_pov)
+        jobs.add("POV-Ray",boost::bind(&FracplanetMain::export_pov,this,filename_base));
+      if (parameters_save.all_blender)
+        jobs.add("Blender",boost::bind(&FracplanetMain::export_blender,this,filename_base+".py",filename_base));
+      if (parameters_save.all_gltf)
+        jobs.add("glTF",boost::bind(&FracplanetMain::export_gltf,this,filename_base+".glb"));
+      if (parameters_save.all_mesh)
+        jobs.add((parameters_save.mesh_obj ? "OBJ" : "PLY"),boost::bind(&FracplanetMain::export_mesh,this,filename_base));
+      if (parameters_save.all_texture)
+        jobs.add("Texture",boost::bind(&FracplanetMain::export_texture,this,filename_base+"."+format.extension<ByteRGBA>(),filename_base));
+
+      progress_start(100,"Saving");
+      concurrent_export=&jobs;
+      jobs.start();
+      while (!jobs.wait(100))
+        {
+          progress_dialog->setLabelText(jobs.info().c_str());
+          progress_step(jobs.percent());
+          application->processEvents();
+        }
+      concurrent_export=0;
+      progress_complete("Saving completed");
+
+      const std::vector<std::string> failed=jobs.failed();
+
+      progress_dialog.reset(0);
+
+      viewer->showNormal();
+      viewer->raise();
+
+      if (!failed.empty())
+    {
+      std::string formats;
+      for (uint i=0;i<failed.size();i++)
+        formats+="\n"+failed[i];
+      QMessageBox::critical(this,"Fracplanet",("Errors ocurred while the files were being written for:"+formats).c_str());
+    }
+    }
+}
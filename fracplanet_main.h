@@ -37,6 +37,8 @@
 #include "triangle_mesh_terrain.h"
 #include "triangle_mesh_viewer.h"
 
+class ConcurrentExport;
+
 //! Top level GUI component for fracplanet application: contains parameter controls and viewing area
 class FracplanetMain : public QWidget,public Progress
 {
@@ -65,11 +67,35 @@ class FracplanetMain : public QWidget,public Progress
   //! Invoked by ControlSave to save to file (Blender format).
   void save_blender();
 
+  //! Invoked by ControlSave to save to file (binary glTF format).
+  void save_gltf();
+
+  //! Invoked by ControlSave to save to file(s) (PLY or OBJ format).
+  void save_mesh();
+
   //! Invoked by ControlSave to save to file as texture(s).
   void save_texture();
 
+  //! Invoked by ControlSave to save to all the selected formats at once, concurrently.
+  void save_all();
+
  private:
 
+  //! Write POV-Ray .pov and .inc files.  Returns false if there were any errors.
+  bool export_pov(const std::string& filename_base);
+
+  //! Write a Blender script (and its binary mesh data files).  Returns false if there were any errors.
+  bool export_blender(const std::string& filename,const std::string& filename_base);
+
+  //! Write a binary glTF file.  Returns false if there were any errors.
+  bool export_gltf(const std::string& filename);
+
+  //! Write PLY or OBJ files.  Returns false if there were any errors.
+  bool export_mesh(const std::string& filename_base);
+
+  //! Write texture images (and whatever else the texture options add).  Returns false if there were any errors.
+  bool export_texture(const std::string& filename,const std::string& filename_base);
+
   //! Control logging.
   const bool _verbose;
 
@@ -103,6 +129,9 @@ class FracplanetMain : public QWidget,public Progress
   std::auto_ptr<QProgressDialog> progress_dialog;
   std::string progress_info;
   bool progress_was_stalled;
+
+  //! While save_all is running, progress reported from its jobs' threads is forwarded here.
+  ConcurrentExport* concurrent_export;
 };
 
 #endif
@@ -0,0 +1,313 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+#include "precompiled.h"
+
+#include "geodesic_grid.h"
+
+#include "subdivision_topology.h"
+
+const uint GeodesicGrid::none=static_cast<uint>(-1);
+
+namespace
+{
+  //! Offset of row r in a triangular arrangement where row r has m-r entries.
+  uint row_offset(uint r,uint m)
+  {
+    return r*m-(r*(r-1))/2;
+  }
+
+  //! Find the row r and column c of entry o in a triangular arrangement where row r has m-r entries.
+  /*! Solves the quadratic for the row directly, then corrects for any rounding.
+   */
+  void triangular_row(uint o,uint m,uint& r,uint& c)
+  {
+    const double b=2.0*m+1.0;
+    const double d=std::max(0.0,b*b-8.0*o);
+    r=static_cast<uint>(std::max(0.0,std::floor(0.5*(b-std::sqrt(d)))));
+    while (r>0 && row_offset(r,m)>o) r--;
+    while (row_offset(r+1,m)<=o) r++;
+    c=o-row_offset(r,m);
+  }
+
+  //! A triangle of the subdivision quadtree, with the lattice points (i,j) of its corners.
+  class QuadtreeNode
+  {
+  public:
+    QuadtreeNode(uint t,uint d,const boost::array<uint,6>& c)
+      :triangle(t)
+      ,depth(d)
+      ,corners(c)
+    {}
+    uint triangle;
+    uint depth;
+    boost::array<uint,6> corners;
+  };
+}
+
+GeodesicGrid::GeodesicGrid(const std::vector<Triangle>& faces,uint level)
+  :_level(level)
+  ,_n(1<<level)
+{
+  assert(faces.size()==20);
+
+  for (uint a=0;a<12;a++)
+    _edge[a].assign(none);
+
+  uint edges=0;
+  for (uint f=0;f<20;f++)
+    for (uint c=0;c<3;c++)
+      {
+        _face[f][c]=faces[f].vertex(c);
+        _vertex_faces[_face[f][c]].push_back(f);
+
+        const uint a=faces[f].vertex(c);
+        const uint b=faces[f].vertex((c+1)%3);
+        if (_edge[a][b]==none)
+          {
+            _edge[a][b]=edges;
+            _edge[b][a]=edges;
+            _edge_vertices[edges]=std::make_pair(std::min(a,b),std::max(a,b));
+            _edge_faces[edges][0]=f;
+            edges++;
+          }
+        else
+          {
+            _edge_faces[_edge[a][b]][1]=f;
+          }
+      }
+  assert(edges==30);
+}
+
+GeodesicGrid::~GeodesicGrid()
+{}
+
+uint GeodesicGrid::index(uint f,uint i,uint j,uint n) const
+{
+  const boost::array<uint,3>& corner=_face[f];
+  if (i==0 && j==0) return corner[0];
+  if (i==n) return corner[1];
+  if (j==n) return corner[2];
+
+  // Points inside edges are numbered from the edge's lower-numbered end.
+  uint p;
+  uint q;
+  uint k;
+  if (j==0)
+    {
+      p=corner[0];q=corner[1];k=i;
+    }
+  else if (i==0)
+    {
+      p=corner[0];q=corner[2];k=j;
+    }
+  else if (i+j==n)
+    {
+      p=corner[1];q=corner[2];k=j;
+    }
+  else
+    {
+      return 12+30*(n-1)+f*(((n-1)*(n-2))/2)+row_offset(i-1,n-2)+(j-1);
+    }
+  return 12+edge(p,q)*(n-1)+(p<q ? k : n-k)-1;
+}
+
+const GeodesicGrid::Address GeodesicGrid::on_edge(uint f,uint p,uint q,uint k,uint n) const
+{
+  const boost::array<uint,3>& corner=_face[f];
+  return Address
+    (
+     f,
+     (corner[1]==p ? n-k : 0)+(corner[1]==q ? k : 0),
+     (corner[2]==p ? n-k : 0)+(corner[2]==q ? k : 0)
+     );
+}
+
+const GeodesicGrid::Address GeodesicGrid::address(uint v,uint n) const
+{
+  if (v<12)
+    {
+      const uint f=_vertex_faces[v][0];
+      const boost::array<uint,3>& corner=_face[f];
+      return Address(f,(corner[1]==v ? n : 0),(corner[2]==v ? n : 0));
+    }
+
+  v-=12;
+  if (v<30*(n-1))
+    {
+      const uint e=v/(n-1);
+      const uint k=v%(n-1)+1;
+      return on_edge(_edge_faces[e][0],_edge_vertices[e].first,_edge_vertices[e].second,k,n);
+    }
+
+  v-=30*(n-1);
+  const uint per_face=((n-1)*(n-2))/2;
+  uint r;
+  uint c;
+  triangular_row(v%per_face,n-2,r,c);
+  return Address(v/per_face,r+1,c+1);
+}
+
+const GeodesicGrid::Address GeodesicGrid::address(uint v) const
+{
+  return address(v,_n);
+}
+
+void GeodesicGrid::addresses(uint v,std::vector<Address>& out) const
+{
+  if (v<12)
+    {
+      for (uint k=0;k<_vertex_faces[v].size();k++)
+        {
+          const uint f=_vertex_faces[v][k];
+          out.push_back(Address(f,(_face[f][1]==v ? _n : 0),(_face[f][2]==v ? _n : 0)));
+        }
+    }
+  else if (v<12+30*(_n-1))
+    {
+      const uint e=(v-12)/(_n-1);
+      const uint k=(v-12)%(_n-1)+1;
+      for (uint s=0;s<2;s++)
+        out.push_back(on_edge(_edge_faces[e][s],_edge_vertices[e].first,_edge_vertices[e].second,k,_n));
+    }
+  else
+    {
+      out.push_back(address(v));
+    }
+}
+
+void GeodesicGrid::neighbours(uint v,std::vector<uint>& out) const
+{
+  const int di[6]={1,0,-1,-1,0,1};
+  const int dj[6]={0,1,1,0,-1,-1};
+
+  const uint first=out.size();
+  std::vector<Address> a;
+  addresses(v,a);
+  for (uint k=0;k<a.size();k++)
+    for (uint d=0;d<6;d++)
+      {
+        const int i=static_cast<int>(a[k].i)+di[d];
+        const int j=static_cast<int>(a[k].j)+dj[d];
+        if (i<0 || j<0 || i+j>static_cast<int>(_n)) continue;
+
+        const uint w=index(a[k].face,i,j,_n);
+        if (std::find(out.begin()+first,out.end(),w)==out.end()) out.push_back(w);
+      }
+}
+
+void GeodesicGrid::triangles_around(uint v,std::vector<Triangle>& out) const
+{
+  std::vector<Address> a;
+  addresses(v,a);
+  for (uint k=0;k<a.size();k++)
+    {
+      const uint f=a[k].face;
+      const int i=a[k].i;
+      const int j=a[k].j;
+      const int n=_n;
+
+      // "Up" triangles (i,j),(i+1,j),(i,j+1) with v at each corner in turn...
+      if (i+j<n) out.push_back(Triangle(index(f,i,j,n),index(f,i+1,j,n),index(f,i,j+1,n)));
+      if (i>0) out.push_back(Triangle(index(f,i-1,j,n),index(f,i,j,n),index(f,i-1,j+1,n)));
+      if (j>0) out.push_back(Triangle(index(f,i,j-1,n),index(f,i+1,j-1,n),index(f,i,j,n)));
+
+      // ...and "down" triangles (i+1,j),(i+1,j+1),(i,j+1) likewise.
+      if (i>0 && j>0) out.push_back(Triangle(index(f,i,j-1,n),index(f,i,j,n),index(f,i-1,j,n)));
+      if (i>0 && i+j<n) out.push_back(Triangle(index(f,i,j,n),index(f,i,j+1,n),index(f,i-1,j+1,n)));
+      if (j>0 && i+j<n) out.push_back(Triangle(index(f,i+1,j-1,n),index(f,i+1,j,n),index(f,i,j,n)));
+    }
+}
+
+const Triangle GeodesicGrid::triangle(uint t) const
+{
+  const uint n=_n;
+  const uint f=t/(n*n);
+  const uint l=t%(n*n);
+  const uint up=(n*(n+1))/2;
+  uint i;
+  uint j;
+  if (l<up)
+    {
+      triangular_row(l,n,i,j);
+      return Triangle(index(f,i,j,n),index(f,i+1,j,n),index(f,i,j+1,n));
+    }
+  else
+    {
+      triangular_row(l-up,n-1,i,j);
+      return Triangle(index(f,i+1,j,n),index(f,i+1,j+1,n),index(f,i,j+1,n));
+    }
+}
+
+uint GeodesicGrid::parent(uint v) const
+{
+  const Address a(address(v));
+  if (_level==0 || a.i%2 || a.j%2) return none;
+  return index(a.face,a.i/2,a.j/2,_n/2);
+}
+
+uint GeodesicGrid::child(uint v) const
+{
+  const Address a(address(v));
+  return index(a.face,2*a.i,2*a.j,2*_n);
+}
+
+void GeodesicGrid::mesh_vertices(const SubdivisionTopology& topology,std::vector<uint>& out) const
+{
+  assert(topology.levels()==_level);
+  assert(topology.triangles().size()==triangles());
+
+  out.assign(vertices(),none);
+
+  // Descend the subdivision quadtree of each face (see TriangleMesh::subdivide for the child order)
+  // tracking the lattice points at the corners of each node.
+  typedef QuadtreeNode Node;
+  std::vector<Node> stack;
+  for (uint f=0;f<20;f++)
+    {
+      const boost::array<uint,6> corners={{0,0,_n,0,0,_n}};
+      stack.push_back(Node(f,0,corners));
+      while (!stack.empty())
+        {
+          const Node node(stack.back());
+          stack.pop_back();
+          const boost::array<uint,6>& p=node.corners;
+
+          if (node.depth==_level)
+            {
+              const Triangle& t=topology.triangles()[node.triangle];
+              for (uint c=0;c<3;c++)
+                out[index(f,p[2*c],p[2*c+1],_n)]=t.vertex(c);
+              continue;
+            }
+
+          const uint m01[2]={(p[0]+p[2])/2,(p[1]+p[3])/2};
+          const uint m12[2]={(p[2]+p[4])/2,(p[3]+p[5])/2};
+          const uint m20[2]={(p[4]+p[0])/2,(p[5]+p[1])/2};
+          const boost::array<uint,6> c0={{p[0],p[1],m01[0],m01[1],m20[0],m20[1]}};
+          const boost::array<uint,6> c1={{m01[0],m01[1],p[2],p[3],m12[0],m12[1]}};
+          const boost::array<uint,6> c2={{m20[0],m20[1],m12[0],m12[1],p[4],p[5]}};
+          const boost::array<uint,6> c3={{m01[0],m01[1],m12[0],m12[1],m20[0],m20[1]}};
+          stack.push_back(Node(4*node.triangle+0,node.depth+1,c0));
+          stack.push_back(Node(4*node.triangle+1,node.depth+1,c1));
+          stack.push_back(Node(4*node.triangle+2,node.depth+1,c2));
+          stack.push_back(Node(4*node.triangle+3,node.depth+1,c3));
+        }
+    }
+}
@@ -0,0 +1,175 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Interface for class GeodesicGrid.
+*/
+
+#ifndef _geodesic_grid_h_
+#define _geodesic_grid_h_
+
+#include "triangle.h"
+
+class SubdivisionTopology;
+
+//! Implicit addressing of the vertices and triangles of a regularly subdivided icosahedron.
+/*! Each of the 20 faces (with corners A,B,C in the winding order of the base triangles)
+  is covered by a triangular lattice of resolution n=2^level.
+  A vertex is addressed within a face as (face,i,j), the lattice point A+i*(B-A)/n+j*(C-A)/n.
+  Points on face edges have two such addresses, and face corners five,
+  so each vertex also has a unique index in [0,vertices()):
+  the 12 icosahedron vertices first, then the points inside each of the 30 edges, then those inside each face.
+  Everything (indices, neighbours, incident triangles, parents and children) is computed arithmetically from a few small tables,
+  so no adjacency graph is needed.
+  The vertex numbering of a mesh built by TriangleMesh::subdivide is different, but mesh_vertices() gives the mapping.
+ */
+class GeodesicGrid
+{
+ public:
+
+  //! Address of a lattice point within a face.
+  class Address
+  {
+  public:
+
+    Address()
+      :face(0)
+      ,i(0)
+      ,j(0)
+      {}
+
+    Address(uint f,uint vi,uint vj)
+      :face(f)
+      ,i(vi)
+      ,j(vj)
+      {}
+
+    uint face;
+    uint i;
+    uint j;
+  };
+
+  //! Constructor.  The faces are the 20 triangles of an icosahedron (over vertices 0-11).
+  GeodesicGrid(const std::vector<Triangle>& faces,uint level);
+
+  //! Destructor.
+  ~GeodesicGrid();
+
+  //! Returned by parent() for vertices not present at the coarser level.
+  static const uint none;
+
+  //! Subdivision level.
+  uint level() const
+    {
+      return _level;
+    }
+
+  //! Lattice resolution along each face edge.
+  uint resolution() const
+    {
+      return _n;
+    }
+
+  //! Number of vertices.
+  uint vertices() const
+    {
+      return 10*_n*_n+2;
+    }
+
+  //! Number of triangles.
+  uint triangles() const
+    {
+      return 20*_n*_n;
+    }
+
+  //! Unique index of the vertex at an address.
+  uint vertex(const Address& a) const
+    {
+      return index(a.face,a.i,a.j,_n);
+    }
+
+  //! An address of a vertex (for face corners and edges, that in the lowest-numbered face containing it).
+  const Address address(uint v) const;
+
+  //! Append all the addresses of vertex v (one, two or five of them) to out.
+  void addresses(uint v,std::vector<Address>& out) const;
+
+  //! Append the indices of the (five or six) vertices adjacent to v to out.
+  void neighbours(uint v,std::vector<uint>& out) const;
+
+  //! Append the (five or six) triangles incident on v to out, wound as the faces are.
+  void triangles_around(uint v,std::vector<Triangle>& out) const;
+
+  //! Triangle t (of triangles()), as vertex indices.
+  /*! Each face contributes n^2 triangles: n(n+1)/2 "up" triangles then n(n-1)/2 "down" ones.
+   */
+  const Triangle triangle(uint t) const;
+
+  //! Index at the next coarser level of vertex v, or none if v was created at this level.
+  uint parent(uint v) const;
+
+  //! Index at the next finer level of vertex v.
+  uint child(uint v) const;
+
+  //! Mesh vertex index for each grid vertex.
+  /*! The topology must be that of subdividing the same faces level times,
+    and the mesh's vertices must still be numbered as subdivide left them.
+   */
+  void mesh_vertices(const SubdivisionTopology& topology,std::vector<uint>& out) const;
+
+ private:
+
+  //! Unique index of lattice point (i,j) of face f, at resolution n.
+  uint index(uint f,uint i,uint j,uint n) const;
+
+  //! Convert an index back to an address at resolution n.
+  const Address address(uint v,uint n) const;
+
+  //! Index of the edge between icosahedron vertices a and b.
+  uint edge(uint a,uint b) const
+    {
+      return _edge[a][b];
+    }
+
+  //! Address in face f of the point k steps (of n) from icosahedron vertex p towards q.
+  const Address on_edge(uint f,uint p,uint q,uint k,uint n) const;
+
+  //! Subdivision level.
+  const uint _level;
+
+  //! Lattice resolution.
+  const uint _n;
+
+  //! Corners of each face.
+  boost::array<boost::array<uint,3>,20> _face;
+
+  //! Index of the edge joining each pair of icosahedron vertices (where they are joined).
+  boost::array<boost::array<uint,12>,12> _edge;
+
+  //! Endpoints (lower first) of each edge.
+  boost::array<std::pair<uint,uint>,30> _edge_vertices;
+
+  //! The two faces sharing each edge (lower first).
+  boost::array<boost::array<uint,2>,30> _edge_faces;
+
+  //! The five faces sharing each icosahedron vertex.
+  boost::array<std::vector<uint>,12> _vertex_faces;
+};
+
+#endif
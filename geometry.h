@@ -33,7 +33,7 @@
   For example, the direction of "up" at a given point will vary depending on whether we are generating a flat world or a spherical one.
   \todo Most of these methods should have their implementation moved geometry.cpp
  */
-class Geometry : public ScanConverter
+class Geometry
 {
 public:
 
@@ -91,11 +91,14 @@ public:
 
  protected:
 
+  //! CubeMapFace projects onto a plane and then rasterises as any other geometry does.
+  friend class CubeMapFace;
+
   //! Common scan-converter code
-  static void scan_convert_common
+  template <class B> static void scan_convert_common
     (
      const boost::array<XYZ,3>& v,
-     const ScanConvertBackend& backend
+     const B& backend
      );
 
   //! Random number generator used for perturbations and the like.
@@ -175,10 +178,11 @@ class GeometryFlat : public Geometry
       return 0.0f;  // No need 'cos heights are stored exactly
     }
 
-  virtual void scan_convert
+  //! Scan convert a triangle into backend (see ScanConvertBackend).
+  template <class B> void scan_convert
     (
      const boost::array<XYZ,3>& v,
-     const ScanConvertBackend&
+     const B& backend
      ) const;
 };
 
@@ -239,7 +243,7 @@ class GeometrySpherical : public Geometry
       if (p.x==0.0f && p.y==0.0f)
     return XYZ(0.0f,0.0f,0.0f);
       else
-    return (up(p)*east(p)).normalised();
+    return (GeometrySpherical::up(p)*GeometrySpherical::east(p)).normalised();
     }
 
   //! East is perpendicular to "up" and the polar vector.
@@ -250,7 +254,7 @@ class GeometrySpherical : public Geometry
       if (p.x==0.0f && p.y==0.0f)
     return XYZ(0.0f,0.0f,0.0f);
       else
-    return (XYZ(0.0f,0.0f,1.0f)*up(p)).normalised();
+    return (XYZ(0.0f,0.0f,1.0f)*GeometrySpherical::up(p)).normalised();
     }
 
   //! Add a random variation to a point.
@@ -263,7 +267,17 @@ class GeometrySpherical : public Geometry
 
       // This, on the other hand, always uses the same number of random numbers, but isn't statistically equivalent:
       const RandomXYZInBox v(_r01,variation);
-      return p+v.x*east(p)+v.y*north(p)+v.z*up(p);
+
+      // Same as east(p), north(p) and up(p), but without recomputing up and east for each.
+      const XYZ u(GeometrySpherical::up(p));
+      XYZ e(0.0f,0.0f,0.0f);
+      XYZ n(0.0f,0.0f,0.0f);
+      if (!(p.x==0.0f && p.y==0.0f))
+    {
+      e=(XYZ(0.0f,0.0f,1.0f)*u).normalised();
+      n=(u*e).normalised();
+    }
+      return p+v.x*e+v.y*n+v.z*u;
     }
 
   //! This needs to return something small for the lake flooding algorithm to work.
@@ -272,10 +286,11 @@ class GeometrySpherical : public Geometry
       return 0.000001f;
     }
 
-  void scan_convert
+  //! Scan convert a triangle into backend (see ScanConvertBackend).
+  template <class B> void scan_convert
     (
      const boost::array<XYZ,3>& v,
-     const ScanConvertBackend&
+     const B& backend
      ) const;
 
   //! Return 2.0 for spheres because vertical range is +/- pi/2, horizontal is +/- pi
@@ -283,6 +298,424 @@ class GeometrySpherical : public Geometry
     {
       return 2;
     }
+
+ private:
+
+  //! Scan convert a triangle with (normalised) vertex p at a pole.
+  template <class B> static void scan_convert_pole
+    (
+     const boost::array<XYZ,3>& vn,
+     uint p,
+     const B& backend
+     );
+
+  //! Whether x range [x0,x1], offset by d map widths, could put any pixels in the map.
+  /*! Conservative by a pixel either side, so it never culls spans the backend would draw.
+   */
+  static bool placement_visible(float x0,float x1,float d,int width)
+    {
+      return (-0.5f<=x1+d*width && x0+d*width<=width+0.5f);
+    }
+};
+
+//! One of the six faces of a cube map of spherical geometry, as a scan converter.
+/*! Directions are projected onto the face from the centre of the sphere (a gnomonic projection), so great circles become straight lines
+  and a triangle's image is itself a triangle, without the wrapping and polar special cases of the equirectangular map.
+  Faces are numbered and oriented as OpenGL cube maps (+x,-x,+y,-y,+z,-z; the north pole is at the centre of the +z face).
+  Triangles are only scanned into faces they could overlap.
+ */
+class CubeMapFace
+{
+ public:
+
+  //! Constructor, for face f (0 to 5).
+  CubeMapFace(uint f);
+
+  //! Destructor.
+  ~CubeMapFace()
+    {}
+
+  //! Short name of face f (e.g "posx"), as used in filenames.
+  static const char* name(uint f);
+
+  //! Scan convert a triangle into backend (see ScanConvertBackend), whose width and height are the face's.
+  template <class B> void scan_convert
+    (
+     const boost::array<XYZ,3>& v,
+     const B& backend
+     ) const;
+
+ private:
+
+  //! Direction of the face's centre.
+  XYZ _axis;
+
+  //! Directions of increasing x and y in the face's image.
+  XYZ _s;
+  XYZ _t;
+};
+
+//! Statically bound view of a concrete geometry.
+/*! Forwards to G's own methods by qualified name, so calls are resolved at compile time
+  and the geometry maths can be inlined into per-vertex loops instead of going through the vtable.
+  Hot mesh stages are written as templates over the geometry type,
+  and instantiated with GeometryStatic<GeometrySpherical>, GeometryStatic<GeometryFlat>
+  or plain (virtual) Geometry after a single dynamic_cast per stage.
+ */
+template <class G> class GeometryStatic
+{
+ public:
+
+  //! Constructor.
+  GeometryStatic(const G& geometry)
+    :_geometry(geometry)
+    {}
+
+  float height(const XYZ& p) const
+    {
+      return _geometry.G::height(p);
+    }
+
+  void set_height(XYZ& p,float v) const
+    {
+      _geometry.G::set_height(p,v);
+    }
+
+  const XYZ midpoint(const XYZ& v0,const XYZ& v1) const
+    {
+      return _geometry.G::midpoint(v0,v1);
+    }
+
+  float normalised_latitude(const XYZ& p) const
+    {
+      return _geometry.G::normalised_latitude(p);
+    }
+
+  const XYZ up(const XYZ& p) const
+    {
+      return _geometry.G::up(p);
+    }
+
+  const XYZ perturb(const XYZ& v,const XYZ& variation) const
+    {
+      return _geometry.G::perturb(v,variation);
+    }
+
+  float epsilon() const
+    {
+      return _geometry.G::epsilon();
+    }
+
+ private:
+
+  //! The geometry viewed.
+  const G& _geometry;
 };
 
+/*! Common scan-converter code
+ */
+template <class B> inline void Geometry::scan_convert_common
+(
+ const boost::array<XYZ,3>& v,
+ const B& backend
+ )
+{
+  // Sort vertices by increasing image y co-ordinate
+  boost::array<uint,3> sort={{0,1,2}};
+  if (v[sort[0]].y>v[sort[1]].y) exchange(sort[0],sort[1]);
+  if (v[sort[1]].y>v[sort[2]].y) exchange(sort[1],sort[2]);
+  if (v[sort[0]].y>v[sort[1]].y) exchange(sort[0],sort[1]);
+
+  // deltas
+  const float x02=v[sort[2]].x-v[sort[0]].x;
+  const float y02=v[sort[2]].y-v[sort[0]].y;
+  const float x01=v[sort[1]].x-v[sort[0]].x;
+  const float y01=v[sort[1]].y-v[sort[0]].y;
+  const float x12=v[sort[2]].x-v[sort[1]].x;
+  const float y12=v[sort[2]].y-v[sort[1]].y;
+
+  boost::optional<float> ky02;
+  boost::optional<float> ky01;
+  boost::optional<float> ky12;
+
+  if (y02==0.0f) return;
+
+  ky02=1.0f/y02;
+  if (y01!=0.0f) ky01=1.0f/y01;
+  if (y12!=0.0f) ky12=1.0f/y12;
+
+  // y range in image co-ordinates
+  const int map_height=backend.height();
+  const int iy_min=static_cast<int>(std::max(0.0f,ceilf(v[sort[0]].y-0.5f)));
+  const int iy_mid=static_cast<int>(floorf(v[sort[1]].y-0.5f));
+  const int iy_max=static_cast<int>(std::min(map_height-0.5f,floorf(v[sort[2]].y-0.5f)));
+
+  if (ky01)
+    for (int iy=iy_min;iy<=iy_mid;iy++)
+      {
+    const float yp02=(iy+0.5f-v[sort[0]].y)*ky02.get();
+    const ScanEdge edge0(v[sort[0]].x+yp02*x02,sort[0],sort[2],yp02);
+
+    const float yp01=(iy+0.5f-v[sort[0]].y)*ky01.get();
+    const ScanEdge edge1(v[sort[0]].x+yp01*x01,sort[0],sort[1],yp01);
+    if (edge0.x<=edge1.x)
+      backend.scan_convert_backend(iy,edge0,edge1);
+    else
+      backend.scan_convert_backend(iy,edge1,edge0);
+      }
+
+  if (ky12)
+    for (int iy=iy_mid+1;iy<=iy_max;iy++)
+      {
+    const float yp02=(iy+0.5f-v[sort[0]].y)*ky02.get();
+    const ScanEdge edge0(v[sort[0]].x+yp02*x02,sort[0],sort[2],yp02);
+
+    const float yp12=(iy+0.5f-v[sort[1]].y)*ky12.get();
+    const ScanEdge edge1(v[sort[1]].x+yp12*x12,sort[1],sort[2],yp12);
+    if (edge0.x<=edge1.x)
+      backend.scan_convert_backend(iy,edge0,edge1);
+    else
+      backend.scan_convert_backend(iy,edge1,edge0);
+      }
+}
+
+/*! Scan lines are through the centre of pixels at y=0.5.
+  This function doesn't care about quantization in x; that's for the backend.
+ */
+template <class B> inline void GeometryFlat::scan_convert
+(
+ const boost::array<XYZ,3>& v,
+ const B& backend
+ ) const
+{
+  const boost::array<XYZ,3> vp
+    ={{
+      XYZ(backend.width()*0.5f*(1.0f+v[0].x),backend.height()*0.5f*(1.0f-v[0].y),0.0f),
+      XYZ(backend.width()*0.5f*(1.0f+v[1].x),backend.height()*0.5f*(1.0f-v[1].y),0.0f),
+      XYZ(backend.width()*0.5f*(1.0f+v[2].x),backend.height()*0.5f*(1.0f-v[2].y),0.0f)
+    }};
+
+  scan_convert_common(vp,backend);
+}
+
+/*! Triangles are projected directly when all their vertices are well in front of the face
+  (within about 75 degrees of its centre; anything on the face is within 55).
+  Those with a vertex further round are culled if they're wholly outside one of the planes bounding the face's view of the sphere,
+  and otherwise bisected (along their longest edge, by the backend) until they are one or the other.
+*/
+template <class B> inline void CubeMapFace::scan_convert
+(
+ const boost::array<XYZ,3>& v,
+ const B& backend
+ ) const
+{
+  const boost::array<XYZ,3> vn={{v[0].normalised(),v[1].normalised(),v[2].normalised()}};
+
+  const bool coplanar=(fabsf((vn[0]*vn[1]).normalised()%vn[2]) < 1e-6f);
+  if (coplanar) return;
+
+  boost::array<float,3> a;
+  boost::array<float,3> s;
+  boost::array<float,3> t;
+  for (uint i=0;i<3;i++)
+    {
+      a[i]=vn[i]%_axis;
+      s[i]=vn[i]%_s;
+      t[i]=vn[i]%_t;
+    }
+
+  if (a[0]<0.25f || a[1]<0.25f || a[2]<0.25f)
+    {
+      if (a[0]<=0.0f && a[1]<=0.0f && a[2]<=0.0f) return;
+      if (s[0]>a[0] && s[1]>a[1] && s[2]>a[2]) return;
+      if (-s[0]>a[0] && -s[1]>a[1] && -s[2]>a[2]) return;
+      if (t[0]>a[0] && t[1]>a[1] && t[2]>a[2]) return;
+      if (-t[0]>a[0] && -t[1]>a[1] && -t[2]>a[2]) return;
+
+      uint longest=0;
+      float longest2=0.0f;
+      for (uint i=0;i<3;i++)
+        {
+          const float l2=(vn[(i+1)%3]-vn[i]).magnitude2();
+          if (l2>longest2)
+            {
+              longest=i;
+              longest2=l2;
+            }
+        }
+
+      // A triangle this small (edges under about 17 degrees) can't reach the face if a vertex is this far round.
+      if (longest2<0.09f) return;
+
+      // The third of the backend's three triangles, along the bisected edge, is degenerate and dropped (as coplanar) when it comes back.
+      boost::array<float,3> w={{0.0f,0.0f,0.0f}};
+      w[longest]=0.5f;
+      w[(longest+1)%3]=0.5f;
+      backend.subdivide(v,0.5f*(v[longest]+v[(longest+1)%3]),w,*this);
+      return;
+    }
+
+  boost::array<XYZ,3> vp;
+  for (uint i=0;i<3;i++)
+    {
+      vp[i].x=backend.width()*0.5f*(1.0f+s[i]/a[i]);
+      vp[i].y=backend.height()*0.5f*(1.0f+t[i]/a[i]);
+      vp[i].z=0.0f;
+    }
+
+  Geometry::scan_convert_common(vp,backend);
+}
+
+/*!
+  The problem with spherical geometry is that spans can go off one side of the map and come back on the other.
+  Triangles are scanned at each placement (offset by a multiple of the width) which can reach the image,
+  so only those straddling the "date line" are scanned twice.
+  A triangle containing a pole is split by the backend into three meeting at the pole,
+  each of which is then scanned by scan_convert_pole.
+*/
+template <class B> inline void GeometrySpherical::scan_convert
+(
+ const boost::array<XYZ,3>& v,
+ const B& backend
+ ) const
+{
+  const boost::array<XYZ,3> vn={{v[0].normalised(),v[1].normalised(),v[2].normalised()}};
+
+  const bool coplanar=(fabsf((vn[0]*vn[1]).normalised()%vn[2]) < 1e-6f);
+  if (coplanar) return;
+
+  {
+    const XYZ pole(0.0f,0.0f,1.0f);
+    const float p01=pole%(v[0]*v[1]);
+    const float p12=pole%(v[1]*v[2]);
+    const float p20=pole%(v[2]*v[0]);
+    const bool contains_pole=((p01>=0.0f && p12>=0.0f && p20>=0.0f) || (p01<=0.0f && p12<=0.0f && p20<=0.0f));
+    if (contains_pole)
+      {
+    // Don't render at all when furthest vertex is so close it won't be rendered
+    const float mx=std::max(fabsf(vn[0].x),std::max(fabsf(vn[1].x),fabsf(vn[2].x)));
+    const float my=std::max(fabsf(vn[0].y),std::max(fabsf(vn[1].y),fabsf(vn[2].y)));
+    const float m=std::max(mx,my);
+    if (m<0.25f/backend.height())
+      return;
+
+    for (uint i=0;i<3;i++)
+      if (vn[i].x==0.0f && vn[i].y==0.0f)
+        {
+          scan_convert_pole(vn,i,backend);
+          return;
+        }
+
+    // The p's are proportional to the pole's barycentric co-ordinates in the triangle.
+    const float k=1.0f/(p01+p12+p20);
+    const boost::array<float,3> w={{k*p12,k*p20,k*p01}};
+    const XYZ which_pole(0.0f,0.0f,((v[0]+v[1]+v[2]).z>0.0f? 1.0f : -1.0f));
+    backend.subdivide(v,which_pole,w,*this);
+    return;
+      }
+  }
+
+  boost::array<XYZ,3> vp;
+  for (uint i=0;i<3;i++)
+    {
+      vp[i].x=backend.width()*0.5f*(1.0f+M_1_PI*atan2f(vn[i].y,vn[i].x));  // atan2f returns [-pi to +pi] so vp[0] in [0,width]
+      if (i!=0)
+    {
+      // Need to keep all the vertices in the same domain
+      if (vp[i].x-vp[0].x>0.5*backend.width()) vp[i].x-=backend.width();
+      else if (vp[i].x-vp[0].x<-0.5*backend.width()) vp[i].x+=backend.width();
+    }
+      vp[i].y=backend.height()*0.5f*(1.0f-asinf(vn[i].z)*M_2_PI);
+      vp[i].z=0.0f;
+    }
+
+  const float x_min=minimum(vp[0].x,vp[1].x,vp[2].x);
+  const float x_max=maximum(vp[0].x,vp[1].x,vp[2].x);
+  for (float d=-1.0f;d<=1.0f;d+=1.0f)
+    {
+      if (!placement_visible(x_min,x_max,d,backend.width())) continue;
+
+      boost::array<XYZ,3> vpt;
+      for (uint i=0;i<3;i++)
+    {
+      vpt[i].x=vp[i].x+d*backend.width();
+      vpt[i].y=vp[i].y;
+      vpt[i].z=vp[i].z;
+    }
+      scan_convert_common(vpt,backend);
+    }
+}
+
+/*! In the map, the triangle's edges to the pole are meridians: vertical lines running to the top (or bottom) row.
+  So its image is the quadrilateral between those and the other edge,
+  each span of which runs between two of the triangle's own edges and can be passed to the backend as usual.
+ */
+template <class B> inline void GeometrySpherical::scan_convert_pole
+(
+ const boost::array<XYZ,3>& vn,
+ uint p,
+ const B& backend
+ )
+{
+  const float width=backend.width();
+  const float height=backend.height();
+
+  uint l=(p+1)%3;
+  uint r=(p+2)%3;
+  float xl=width*0.5f*(1.0f+M_1_PI*atan2f(vn[l].y,vn[l].x));
+  float xr=width*0.5f*(1.0f+M_1_PI*atan2f(vn[r].y,vn[r].x));
+  if (xr-xl>0.5f*width) xr-=width;
+  else if (xr-xl<-0.5f*width) xr+=width;
+  if (xr<xl)
+    {
+      exchange(l,r);
+      exchange(xl,xr);
+    }
+
+  // Rows are handled in terms of their distance t from the pole's edge of the map.
+  const float y_pole=(vn[p].z>0.0f ? 0.0f : height);
+  const float tl=fabsf(height*0.5f*(1.0f-asinf(vn[l].z)*M_2_PI)-y_pole);
+  const float tr=fabsf(height*0.5f*(1.0f-asinf(vn[r].z)*M_2_PI)-y_pole);
+  const float t_max=std::max(tl,tr);
+
+  const float y_min=(y_pole==0.0f ? 0.0f : height-t_max);
+  const float y_max=(y_pole==0.0f ? t_max : height);
+  const int iy_min=static_cast<int>(std::max(0.0f,ceilf(y_min-0.5f)));
+  const int iy_max=static_cast<int>(std::min(height-0.5f,floorf(y_max-0.5f)));
+
+  for (int iy=iy_min;iy<=iy_max;iy++)
+    {
+      const float t=fabsf(iy+0.5f-y_pole);
+
+      ScanEdge edge0;
+      if (t<=tl)
+    edge0=ScanEdge(xl,p,l,(tl>0.0f ? t/tl : 0.0f));
+      else
+    {
+      const float lambda=(t-tl)/(tr-tl);
+      edge0=ScanEdge(xl+lambda*(xr-xl),l,r,lambda);
+    }
+
+      ScanEdge edge1;
+      if (t<=tr)
+    edge1=ScanEdge(xr,p,r,(tr>0.0f ? t/tr : 0.0f));
+      else
+    {
+      const float lambda=(t-tr)/(tl-tr);
+      edge1=ScanEdge(xr+lambda*(xl-xr),r,l,lambda);
+    }
+
+      // Replicate the span to each placement reaching the image.
+      for (float d=-1.0f;d<=1.0f;d+=1.0f)
+    if (placement_visible(xl,xr,d,backend.width()))
+      {
+        ScanEdge e0(edge0);
+        ScanEdge e1(edge1);
+        e0.x+=d*width;
+        e1.x+=d*width;
+        backend.scan_convert_backend(iy,e0,e1);
+      }
+    }
+}
+
 #endif
@@ -0,0 +1,363 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Implementation of class GltfWriter.
+*/
+
+#include "precompiled.h"
+
+#include "gltf_writer.h"
+
+#include "async_ofstream.h"
+#include "little_endian.h"
+#include "parallel.h"
+#include "progress.h"
+#include "triangle_mesh.h"
+
+namespace
+{
+  //! glTF accessor component types.
+  enum
+  {
+    gltf_byte=5120,
+    gltf_short=5122,
+    gltf_unsigned_short=5123,
+    gltf_unsigned_int=5125,
+    gltf_float=5126
+  };
+
+  //! glTF buffer view targets.
+  enum
+  {
+    gltf_array_buffer=34962,
+    gltf_element_array_buffer=34963
+  };
+
+  //! v (nominally in [-1,1]) as a normalised integer in [-limit,limit].
+  inline int quantised(float v,int limit)
+  {
+    return clamped(static_cast<int>(floor(v*limit+0.5f)),-limit,limit);
+  }
+
+  //! Quote a string as a JSON string.
+  std::string json_string(const std::string& s)
+  {
+    std::string q("\"");
+    for (std::string::const_iterator it=s.begin();it!=s.end();it++)
+      {
+        if (*it=='\\' || *it=='"') q+='\\';
+        q+=*it;
+      }
+    return q+"\"";
+  }
+
+  //! Append a named array of JSON objects to a JSON object's members (glTF doesn't allow empty arrays, so they're omitted).
+  void append_array(std::ostringstream& json,const std::string& name,const std::vector<std::string>& objects)
+  {
+    if (objects.empty()) return;
+    json << ",\"" << name << "\":[";
+    for (uint i=0;i<objects.size();i++)
+      json << (i ? "," : "") << objects[i];
+    json << "]";
+  }
+
+  //! Packs the positions of exported vertices [begin,end), for parallel_for.
+  /*! Quantised positions are (p-centre)*inverse_scale in [-1,1] scaled to shorts, padded to 8 bytes; otherwise they're floats.
+   */
+  void pack_positions(const TriangleMesh& mesh,const TriangleMesh::ExportedVertices& exported,const XYZ& centre,float inverse_scale,bool quantise,uchar* out,uint begin,uint end)
+  {
+    for (uint v=begin;v<end;v++)
+      {
+        const XYZ& p=mesh.vertex(exported.mesh_vertex(v)).position();
+        if (quantise)
+          {
+            const XYZ q((p-centre)*inverse_scale);
+            uchar*const o=out+8*v;
+            store_little_endian(o,static_cast<ushort>(quantised(q.x,32767)));
+            store_little_endian(o+2,static_cast<ushort>(quantised(q.y,32767)));
+            store_little_endian(o+4,static_cast<ushort>(quantised(q.z,32767)));
+            store_little_endian(o+6,static_cast<ushort>(0));
+          }
+        else
+          {
+            uchar*const o=out+12*v;
+            store_little_endian(o,p.x);
+            store_little_endian(o+4,p.y);
+            store_little_endian(o+8,p.z);
+          }
+      }
+  }
+
+  //! Packs the (unit) normals of exported vertices [begin,end), for parallel_for.
+  /*! Quantised normals are normalised signed bytes, padded to 4 bytes; otherwise they're floats.
+   */
+  void pack_normals(const TriangleMesh& mesh,const TriangleMesh::ExportedVertices& exported,bool quantise,uchar* out,uint begin,uint end)
+  {
+    for (uint v=begin;v<end;v++)
+      {
+        XYZ n(mesh.vertex(exported.mesh_vertex(v)).normal());
+        const float m=n.magnitude();
+        n=(m>0.0f ? n/m : XYZ(0.0f,0.0f,1.0f));
+        if (quantise)
+          {
+            uchar*const o=out+4*v;
+            o[0]=static_cast<uchar>(quantised(n.x,127));
+            o[1]=static_cast<uchar>(quantised(n.y,127));
+            o[2]=static_cast<uchar>(quantised(n.z,127));
+            o[3]=0;
+          }
+        else
+          {
+            uchar*const o=out+12*v;
+            store_little_endian(o,n.x);
+            store_little_endian(o+4,n.y);
+            store_little_endian(o+8,n.z);
+          }
+      }
+  }
+
+  //! Packs colour c of exported vertices [begin,end) as normalised unsigned shorts, for parallel_for.
+  /*! glTF vertex colours are linear, so the (sRGB) colour components go through the linear table; alpha is unchanged.
+   */
+  void pack_colours(const TriangleMesh& mesh,const TriangleMesh::ExportedVertices& exported,uint c,const std::vector<ushort>& linear,uchar* out,uint begin,uint end)
+  {
+    for (uint v=begin;v<end;v++)
+      {
+        const ByteRGBA& colour=mesh.vertex(exported.mesh_vertex(v)).colour(c);
+        uchar*const o=out+8*v;
+        store_little_endian(o,linear[colour.r]);
+        store_little_endian(o+2,linear[colour.g]);
+        store_little_endian(o+4,linear[colour.b]);
+        store_little_endian(o+6,static_cast<ushort>(257*colour.a));
+      }
+  }
+
+  //! Packs the exported vertex indices of triangles first+[begin,end), for parallel_for.
+  void pack_indices(const TriangleMesh& mesh,const TriangleMesh::ExportedVertices& exported,uint first,uchar* out,uint begin,uint end)
+  {
+    for (uint t=begin;t<end;t++)
+      {
+        const Triangle& tri=mesh.triangle(first+t);
+        for (uint i=0;i<3;i++)
+          store_little_endian(out+12*t+4*i,exported.exported_vertex(tri.vertex(i)));
+      }
+  }
+}
+
+GltfWriter::GltfWriter(bool quantise,Progress* progress)
+  :_quantise(quantise)
+  ,_progress(progress)
+{}
+
+GltfWriter::~GltfWriter()
+{}
+
+uint GltfWriter::add_buffer_view(uint bytes,uint stride,uint& offset)
+{
+  offset=_bin.size();
+  _bin.resize(offset+(bytes+3)/4*4,0);
+
+  std::ostringstream view;
+  view << "{\"buffer\":0,\"byteOffset\":" << offset << ",\"byteLength\":" << bytes;
+  if (stride)
+    view << ",\"byteStride\":" << stride << ",\"target\":" << gltf_array_buffer;
+  else
+    view << ",\"target\":" << gltf_element_array_buffer;
+  view << "}";
+  _buffer_views.push_back(view.str());
+  return _buffer_views.size()-1;
+}
+
+uint GltfWriter::add_accessor(uint view,uint component_type,bool normalized,uint count,const std::string& type,const std::string& min_max)
+{
+  std::ostringstream accessor;
+  accessor
+    << "{\"bufferView\":" << view
+    << ",\"componentType\":" << component_type
+    << (normalized ? ",\"normalized\":true" : "")
+    << ",\"count\":" << count
+    << ",\"type\":\"" << type << "\""
+    << min_max
+    << "}";
+  _accessors.push_back(accessor.str());
+  return _accessors.size()-1;
+}
+
+/*! Positions and normals are shared by the mesh's primitives; each primitive has its own colours and indices.
+  Quantised positions are mapped into [-32767,32767] by the mesh's bounding box centre and (uniform, so normals are unaffected) half size,
+  which the node's translation and scale undo.
+ */
+void GltfWriter::add(const TriangleMesh& mesh,const std::string& name,bool blend)
+{
+  ProgressScope progress(4,"Packing mesh "+name+" for glTF",_progress);
+
+  const TriangleMesh::ExportedVertices exported(mesh,0,mesh.triangles());
+  const uint n=exported.vertices();
+  if (n==0) return;
+
+  XYZ lo(mesh.vertex(exported.mesh_vertex(0)).position());
+  XYZ hi(lo);
+  for (uint v=1;v<n;v++)
+    {
+      const XYZ& p=mesh.vertex(exported.mesh_vertex(v)).position();
+      lo=XYZ(minimum(lo.x,p.x),minimum(lo.y,p.y),minimum(lo.z,p.z));
+      hi=XYZ(maximum(hi.x,p.x),maximum(hi.y,p.y),maximum(hi.z,p.z));
+    }
+  const XYZ centre(0.5f*(lo+hi));
+  const float half_size=0.5f*maximum(hi.x-lo.x,hi.y-lo.y,hi.z-lo.z);
+  const float scale=(half_size>0.0f ? half_size : 1.0f);
+
+  uint offset;
+
+  std::ostringstream position_bounds;
+  position_bounds << std::setprecision(9);
+  if (_quantise)
+    {
+      const XYZ qlo((lo-centre)*(1.0f/scale));
+      const XYZ qhi((hi-centre)*(1.0f/scale));
+      position_bounds
+        << ",\"min\":[" << quantised(qlo.x,32767) << "," << quantised(qlo.y,32767) << "," << quantised(qlo.z,32767) << "]"
+        << ",\"max\":[" << quantised(qhi.x,32767) << "," << quantised(qhi.y,32767) << "," << quantised(qhi.z,32767) << "]";
+    }
+  else
+    {
+      position_bounds
+        << ",\"min\":[" << lo.x << "," << lo.y << "," << lo.z << "]"
+        << ",\"max\":[" << hi.x << "," << hi.y << "," << hi.z << "]";
+    }
+  const uint position_size=(_quantise ? 8 : 12);
+  const uint position_view=add_buffer_view(n*position_size,position_size,offset);
+  parallel_for(n,boost::bind(&pack_positions,boost::cref(mesh),boost::cref(exported),centre,1.0f/scale,_quantise,&_bin[offset],_1,_2));
+  const uint position=add_accessor(position_view,(_quantise ? gltf_short : gltf_float),false,n,"VEC3",position_bounds.str());
+  progress.step();
+
+  const uint normal_size=(_quantise ? 4 : 12);
+  const uint normal_view=add_buffer_view(n*normal_size,normal_size,offset);
+  parallel_for(n,boost::bind(&pack_normals,boost::cref(mesh),boost::cref(exported),_quantise,&_bin[offset],_1,_2));
+  const uint normal=add_accessor(normal_view,(_quantise ? gltf_byte : gltf_float),_quantise,n,"VEC3","");
+  progress.step();
+
+  std::vector<ushort> linear(256);
+  for (uint i=0;i<256;i++)
+    {
+      const float s=i/255.0f;
+      const float l=(s<=0.04045f ? s/12.92f : pow((s+0.055f)/1.055f,2.4f));
+      linear[i]=static_cast<ushort>(floor(65535.0f*l+0.5f));
+    }
+
+  const uint first[3]={0,mesh.triangles_of_colour0(),mesh.triangles()};
+  std::ostringstream primitives;
+  for (uint c=0;c<2;c++)
+    {
+      const uint triangles=first[c+1]-first[c];
+      if (triangles==0) continue;
+
+      const uint colour_view=add_buffer_view(8*n,8,offset);
+      parallel_for(n,boost::bind(&pack_colours,boost::cref(mesh),boost::cref(exported),c,boost::cref(linear),&_bin[offset],_1,_2));
+      const uint colour=add_accessor(colour_view,gltf_unsigned_short,true,n,"VEC4","");
+
+      const uint index_view=add_buffer_view(12*triangles,0,offset);
+      parallel_for(triangles,boost::bind(&pack_indices,boost::cref(mesh),boost::cref(exported),first[c],&_bin[offset],_1,_2));
+      const uint indices=add_accessor(index_view,gltf_unsigned_int,false,3*triangles,"SCALAR","");
+
+      std::ostringstream material;
+      material
+        << "{\"name\":" << json_string(name+(c ? "1" : "0"))
+        << ",\"pbrMetallicRoughness\":{\"metallicFactor\":0,\"roughnessFactor\":1}"
+        << (blend ? ",\"alphaMode\":\"BLEND\",\"doubleSided\":true" : "")
+        << "}";
+      _materials.push_back(material.str());
+
+      primitives
+        << (primitives.str().empty() ? "" : ",")
+        << "{\"attributes\":{\"POSITION\":" << position << ",\"NORMAL\":" << normal << ",\"COLOR_0\":" << colour << "}"
+        << ",\"indices\":" << indices
+        << ",\"material\":" << _materials.size()-1
+        << "}";
+    }
+  progress.step();
+
+  std::ostringstream json_mesh;
+  json_mesh << "{\"name\":" << json_string(name) << ",\"primitives\":[" << primitives.str() << "]}";
+  _meshes.push_back(json_mesh.str());
+
+  // Rotating -90 degrees about x takes the mesh's z (up) to glTF's y; the translation is of the rotated centre.
+  std::ostringstream node;
+  node << std::setprecision(9);
+  node << "{\"name\":" << json_string(name) << ",\"mesh\":" << _meshes.size()-1 << ",\"rotation\":[-0.707106781,0,0,0.707106781]";
+  if (_quantise)
+    node
+      << ",\"translation\":[" << centre.x << "," << centre.z << "," << -centre.y << "]"
+      << ",\"scale\":[" << scale/32767.0f << "," << scale/32767.0f << "," << scale/32767.0f << "]";
+  node << "}";
+  _nodes.push_back(node.str());
+  progress.step();
+}
+
+/*! The file is a 12 byte header, then the JSON chunk (space padded), then the binary chunk (its buffer views are already padded).
+ */
+bool GltfWriter::write(const std::string& filename) const
+{
+  std::ostringstream json;
+  json << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"Fracplanet\"}";
+  if (_quantise)
+    json << ",\"extensionsUsed\":[\"KHR_mesh_quantization\"],\"extensionsRequired\":[\"KHR_mesh_quantization\"]";
+  json << ",\"scene\":0,\"scenes\":[{";
+  if (!_nodes.empty())
+    {
+      json << "\"nodes\":[";
+      for (uint i=0;i<_nodes.size();i++)
+        json << (i ? "," : "") << i;
+      json << "]";
+    }
+  json << "}]";
+  append_array(json,"nodes",_nodes);
+  append_array(json,"meshes",_meshes);
+  append_array(json,"materials",_materials);
+  append_array(json,"accessors",_accessors);
+  append_array(json,"bufferViews",_buffer_views);
+  if (!_bin.empty())
+    json << ",\"buffers\":[{\"byteLength\":" << _bin.size() << "}]";
+  json << "}";
+
+  std::string text(json.str());
+  text.resize((text.size()+3)/4*4,' ');
+
+  uchar header[20];
+  store_little_endian(header,0x46546c67u);  // "glTF"
+  store_little_endian(header+4,2u);
+  store_little_endian(header+8,static_cast<uint>(12+8+text.size()+(_bin.empty() ? 0 : 8+_bin.size())));
+  store_little_endian(header+12,static_cast<uint>(text.size()));
+  store_little_endian(header+16,0x4e4f534au);  // "JSON"
+
+  AsyncOfstream out(filename,12+8+text.size()+(_bin.empty() ? 0 : 8+_bin.size()));
+  out.write(reinterpret_cast<const char*>(header),sizeof(header));
+  out.write(text.data(),text.size());
+  if (!_bin.empty())
+    {
+      uchar chunk[8];
+      store_little_endian(chunk,static_cast<uint>(_bin.size()));
+      store_little_endian(chunk+4,0x004e4942u);  // "BIN"
+      out.write(reinterpret_cast<const char*>(chunk),sizeof(chunk));
+      out.write(reinterpret_cast<const char*>(&_bin[0]),_bin.size());
+    }
+  out.close();
+  return out;
+}
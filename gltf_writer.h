@@ -0,0 +1,88 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Interface for class GltfWriter.
+*/
+
+#ifndef _gltf_writer_h_
+#define _gltf_writer_h_
+
+class Progress;
+class TriangleMesh;
+
+//! Accumulates meshes for a binary glTF 2.0 (.glb) file.
+/*! Each mesh becomes a node of its own (rotated so the mesh's z, up, is glTF's y),
+  with a primitive (and material) for each vertex colour its triangles use,
+  sharing the vertex positions and normals but each with its own colours.
+  Mesh data is packed into the binary buffer (in parallel) as it's added, so meshes needn't outlive add();
+  write() just emits the JSON description and the buffer.
+ */
+class GltfWriter : public boost::noncopyable
+{
+ public:
+
+  //! Constructor.
+  /*! If quantise, positions are stored as shorts (scaled back by their node's transform)
+    and normals as normalised bytes, as allowed by the KHR_mesh_quantization extension.
+   */
+  GltfWriter(bool quantise,Progress* progress);
+
+  //! Destructor.
+  ~GltfWriter();
+
+  //! Add a mesh (only the vertices its triangles use).
+  /*! If blend, its vertex alpha is used for (double sided) transparency; otherwise it's opaque.
+   */
+  void add(const TriangleMesh& mesh,const std::string& name,bool blend);
+
+  //! Write the .glb file.  Returns false if there were any errors.
+  bool write(const std::string& filename) const;
+
+ private:
+
+  //! Append a 4-byte aligned buffer view of bytes to the binary buffer.
+  /*! Returns the view's index; its data starts at _bin[offset].
+    A stride of 0 is for index data.
+   */
+  uint add_buffer_view(uint bytes,uint stride,uint& offset);
+
+  //! Append an accessor, returning its index.
+  /*! min_max is the accessor's min and max members (with a leading comma) or empty.
+   */
+  uint add_accessor(uint view,uint component_type,bool normalized,uint count,const std::string& type,const std::string& min_max);
+
+  //! Whether attributes are quantised.
+  const bool _quantise;
+
+  //! Progress reports go here.
+  Progress*const _progress;
+
+  //! The binary buffer.
+  std::vector<uchar> _bin;
+
+  //! JSON objects for the arrays of the same names.
+  std::vector<std::string> _buffer_views;
+  std::vector<std::string> _accessors;
+  std::vector<std::string> _materials;
+  std::vector<std::string> _meshes;
+  std::vector<std::string> _nodes;
+};
+
+#endif
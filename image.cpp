@@ -44,6 +44,7 @@
 
 #include "image.h"
 
+#include "parallel.h"
 #include "progress.h"
 #include "rgb.h"
 
@@ -72,18 +73,318 @@ template <typename T> const typename Raster<T>::ScalarType Raster<T>::maximum_sc
   return m;
 }
 
+namespace
+{
+  //! Packs 8-bit samples as they are.
+  class PackBytes
+  {
+  public:
+    static const uint bytes=1;
+    void operator()(const uchar* src,uint n,uchar* dst) const
+    {
+      memcpy(dst,src,n);
+    }
+  };
+
+  //! Packs 16-bit samples most significant byte first (as the PGM spec requires).
+  class PackMSBFirst
+  {
+  public:
+    static const uint bytes=2;
+    void operator()(const ushort* src,uint n,uchar* dst) const
+    {
+      for (uint i=0;i<n;i++)
+        {
+          dst[2*i  ]=(src[i]>>8);
+          dst[2*i+1]=(src[i]&0xff);
+        }
+    }
+  };
+
+  //! Packs 16-bit samples known to be less than 256 as single bytes.
+  class PackLowByte
+  {
+  public:
+    static const uint bytes=1;
+    void operator()(const ushort* src,uint n,uchar* dst) const
+    {
+      for (uint i=0;i<n;i++)
+        dst[i]=src[i];
+    }
+  };
+
+  //! Packs RGBA pixels as RGB, dropping alpha.
+  class PackRGB
+  {
+  public:
+    static const uint bytes=3;
+    void operator()(const ByteRGBA* src,uint n,uchar* dst) const
+    {
+      for (uint i=0;i<n;i++)
+        {
+          dst[3*i  ]=src[i].r;
+          dst[3*i+1]=src[i].g;
+          dst[3*i+2]=src[i].b;
+        }
+    }
+  };
+
+  //! Pack rows [first+begin,first+end) of raster into their place in buffer (which starts with row first), for parallel_for.
+  template <typename T,class P> void pack_row_range(const Raster<T>& raster,uint first,uchar* buffer,P pack,uint begin,uint end)
+  {
+    const size_t row_bytes=static_cast<size_t>(P::bytes)*raster.width();
+    for (uint r=begin;r<end;r++)
+      pack(raster.row(first+r),raster.width(),buffer+r*row_bytes);
+  }
+
+  //! Pack rows [begin,end) of raster into buffer, ready to be written in one go.
+  /*! The loops in the packers are simple enough for the compiler to vectorise,
+    and big enough batches of rows are packed in parallel (smaller ones, such as tiles, which may already be being written in parallel, aren't).
+   */
+  template <typename T,class P> void pack_rows(const Raster<T>& raster,uint begin,uint end,std::vector<uchar>& buffer,P pack)
+  {
+    buffer.resize(static_cast<size_t>(P::bytes)*raster.width()*(end-begin));
+    if (buffer.empty()) return;
+    if (buffer.size()<(1u<<22))
+      pack_row_range(raster,begin,&buffer[0],pack,0,end-begin);
+    else
+      parallel_for(end-begin,boost::bind(&pack_row_range<T,P>,boost::cref(raster),begin,&buffer[0],pack,_1,_2));
+  }
+
+  //! Write a packed buffer (if there's anything in it).
+  void write_buffer(std::ostream& out,const std::vector<uchar>& buffer)
+  {
+    if (!buffer.empty()) out.write(reinterpret_cast<const char*>(&buffer[0]),buffer.size());
+  }
+
+  //! Write a whole raster a few megabytes of packed rows at a time.
+  template <typename T,class P> void write_rows(const Raster<T>& raster,std::ostream& out,P pack,ProgressScope& progress)
+  {
+    const uint rows=std::max(1u,(1u<<24)/(P::bytes*std::max(1u,raster.width())));
+    std::vector<uchar> buffer;
+    for (uint begin=0;begin<raster.height();begin+=rows)
+      {
+        const uint end=std::min(raster.height(),begin+rows);
+        pack_rows(raster,begin,end,buffer,pack);
+        write_buffer(out,buffer);
+        for (uint r=begin;r<end;r++) progress.step();
+      }
+  }
+
+  //! Packing, and PNG image type, of each pixel type RasterWriter writes.
+  template <typename T> class PixelPacking;
+
+  template <> class PixelPacking<uchar>
+  {
+  public:
+    typedef PackBytes Pack;
+    static const uchar png_bit_depth=8;
+    static const uchar png_colour_type=0;
+  };
+
+  template <> class PixelPacking<ushort>
+  {
+  public:
+    typedef PackMSBFirst Pack;
+    static const uchar png_bit_depth=16;
+    static const uchar png_colour_type=0;
+  };
+
+  template <> class PixelPacking<ByteRGBA>
+  {
+  public:
+    typedef PackRGB Pack;
+    static const uchar png_bit_depth=8;
+    static const uchar png_colour_type=2;
+  };
+
+  //! Room for a Netpbm header, for estimating file sizes.
+  const unsigned long long netpbm_header_size=32;
+
+  //! Write the Netpbm header for an image of pixel type T, noting where any maxval to be filled in later goes.
+  template <typename T> void write_netpbm_header(std::ostream& out,uint width,uint height,std::streampos&)
+  {
+    out << "P5" << std::endl;
+    out << width << " " << height << std::endl;
+    out << "255" << std::endl;
+  }
+
+  template <> void write_netpbm_header<ushort>(std::ostream& out,uint width,uint height,std::streampos& maximum_position)
+  {
+    out << "P5" << std::endl;
+    out << width << " " << height << std::endl;
+    maximum_position=out.tellp();
+    out << "     " << std::endl;  // Room for any 16-bit maxval
+  }
+
+  template <> void write_netpbm_header<ByteRGBA>(std::ostream& out,uint width,uint height,std::streampos&)
+  {
+    out << "P6" << std::endl;
+    out << width << " " << height << std::endl;
+    out << "255" << std::endl;
+  }
+
+  //! Store v in 4 bytes, most significant first (as all PNG integers are).
+  void store_uint32(uint v,uchar* p)
+  {
+    p[0]=(v>>24);
+    p[1]=((v>>16)&0xff);
+    p[2]=((v>>8)&0xff);
+    p[3]=(v&0xff);
+  }
+
+  //! Write a PNG chunk: length, type, data and CRC (of type and data).
+  void write_png_chunk(std::ostream& out,const char* type,const uchar* data,uint size)
+  {
+    uchar length[4];
+    store_uint32(size,length);
+    out.write(reinterpret_cast<const char*>(length),4);
+    out.write(type,4);
+    if (size) out.write(reinterpret_cast<const char*>(data),size);
+    uLong crc=crc32(0,Z_NULL,0);
+    crc=crc32(crc,reinterpret_cast<const Bytef*>(type),4);
+    if (size) crc=crc32(crc,data,size);
+    uchar check[4];
+    store_uint32(crc,check);
+    out.write(reinterpret_cast<const char*>(check),4);
+  }
+
+  //! Write the PNG signature and header, and the zlib stream header as the start of the image data.
+  void write_png_header(std::ostream& out,uint width,uint height,uchar bit_depth,uchar colour_type,uint compression)
+  {
+    const uchar signature[8]={0x89,'P','N','G','\r','\n',0x1a,'\n'};
+    out.write(reinterpret_cast<const char*>(signature),8);
+
+    uchar header[13];
+    store_uint32(width,header);
+    store_uint32(height,header+4);
+    header[8]=bit_depth;
+    header[9]=colour_type;
+    header[10]=0;  // Deflate
+    header[11]=0;  // Adaptive filtering
+    header[12]=0;  // Not interlaced
+    write_png_chunk(out,"IHDR",header,13);
+
+    // Deflate with a 32K window, the level hint zlib itself would give, and check bits making the pair a multiple of 31.
+    const uint level_hint=(compression<2 ? 0 : (compression<6 ? 1 : (compression==6 ? 2 : 3)));
+    uchar zlib_header[2]={0x78,static_cast<uchar>(level_hint<<6)};
+    zlib_header[1]+=31-((zlib_header[0]*256+zlib_header[1])%31);
+    write_png_chunk(out,"IDAT",zlib_header,2);
+  }
+
+  //! Deflated PNG image data for a chunk of rows, with the Adler-32 checksum and length of the (filtered) data deflated.
+  class DeflatedRows
+  {
+  public:
+    DeflatedRows()
+      :adler(1)
+      ,length(0)
+      ,ok(false)
+    {}
+    std::vector<uchar> data;
+    uint adler;
+    size_t length;
+    bool ok;
+  };
+
+  //! Filter and deflate chunks [begin,end) of packed rows, for parallel_for.
+  /*! Each row is Sub filtered (every byte less the one a pixel before), which suits smooth terrain and heights well
+    and depends on nothing outside the row.
+    Each chunk is raw deflated independently and ended with a sync flush (an empty stored block, leaving it byte aligned)
+    so chunks can simply be concatenated, as pigz does.
+   */
+  void deflate_rows(const std::vector<uchar>& packed,uint row_bytes,uint pixel_bytes,uint chunk_rows,uint compression,std::vector<DeflatedRows>& chunks,uint begin,uint end)
+  {
+    const uint rows=packed.size()/row_bytes;
+    std::vector<uchar> filtered;
+    for (uint c=begin;c<end;c++)
+      {
+        const uint row_begin=c*chunk_rows;
+        const uint row_end=std::min(rows,row_begin+chunk_rows);
+
+        filtered.resize(static_cast<size_t>(row_end-row_begin)*(row_bytes+1));
+        uchar* f=&filtered[0];
+        for (uint r=row_begin;r<row_end;r++)
+          {
+            const uchar*const p=&packed[static_cast<size_t>(r)*row_bytes];
+            *(f++)=1;
+            for (uint i=0;i<pixel_bytes;i++)
+              f[i]=p[i];
+            for (uint i=pixel_bytes;i<row_bytes;i++)
+              f[i]=p[i]-p[i-pixel_bytes];
+            f+=row_bytes;
+          }
+
+        DeflatedRows& chunk=chunks[c];
+        chunk.length=filtered.size();
+        chunk.adler=adler32(adler32(0,Z_NULL,0),&filtered[0],filtered.size());
+
+        z_stream z;
+        z.zalloc=Z_NULL;
+        z.zfree=Z_NULL;
+        z.opaque=Z_NULL;
+        if (deflateInit2(&z,compression,Z_DEFLATED,-15,8,Z_DEFAULT_STRATEGY)!=Z_OK) continue;
+
+        chunk.data.resize(deflateBound(&z,filtered.size())+16);
+        z.next_in=&filtered[0];
+        z.avail_in=filtered.size();
+        z.next_out=&chunk.data[0];
+        z.avail_out=chunk.data.size();
+        int status;
+        for (;;)
+          {
+            status=deflate(&z,Z_SYNC_FLUSH);
+            if (status!=Z_OK || z.avail_out!=0) break;
+            // Out of room (unlikely, given deflateBound), so there may be more to come.
+            const size_t used=chunk.data.size();
+            chunk.data.resize(2*used);
+            z.next_out=&chunk.data[used];
+            z.avail_out=chunk.data.size()-used;
+          }
+        chunk.data.resize(chunk.data.size()-z.avail_out);
+        chunk.ok=(status==Z_OK && z.avail_in==0);
+        deflateEnd(&z);
+      }
+  }
+
+  //! Append packed rows to a PNG's image data, deflating chunks of about a megabyte in parallel, and update its checksum.
+  bool write_png_rows(std::ostream& out,const std::vector<uchar>& packed,uint row_bytes,uint pixel_bytes,uint compression,uint& adler)
+  {
+    if (packed.empty()) return true;
+
+    const uint rows=packed.size()/row_bytes;
+    const uint chunk_rows=std::max(1u,(1u<<20)/(row_bytes+1));
+    std::vector<DeflatedRows> chunks((rows+chunk_rows-1)/chunk_rows);
+    parallel_for(chunks.size(),boost::bind(&deflate_rows,boost::cref(packed),row_bytes,pixel_bytes,chunk_rows,compression,boost::ref(chunks),_1,_2));
+
+    bool ok=true;
+    for (uint c=0;c<chunks.size();c++)
+      {
+        if (!chunks[c].ok) ok=false;
+        adler=adler32_combine(adler,chunks[c].adler,chunks[c].length);
+        if (!chunks[c].data.empty()) write_png_chunk(out,"IDAT",&chunks[c].data[0],chunks[c].data.size());
+      }
+    return ok;
+  }
+
+  //! Finish a PNG: end the zlib stream (with an empty final block and the checksum) and write the end chunk.
+  void write_png_end(std::ostream& out,uint adler)
+  {
+    uchar end[6]={0x03,0x00};  // An empty final block, with fixed Huffman codes
+    store_uint32(adler,end+2);
+    write_png_chunk(out,"IDAT",end,6);
+    write_png_chunk(out,"IEND",0,0);
+  }
+}
+
 template <> bool Raster<uchar>::write_pgmfile(const std::string& filename,Progress* target) const
 {
   ProgressScope progress(height(),"Writing PGM image:\n"+filename,target);
-  std::ofstream out(filename.c_str(),std::ios::binary);
+  AsyncOfstream out(filename,netpbm_header_size+static_cast<unsigned long long>(width())*height());
   out << "P5" << std::endl;
   out << width() << " " << height() << std::endl;
   out << "255" << std::endl;
-  for (ConstRowIterator row=row_begin();row!=row_end();++row)
-    {
-      progress.step();
-      out.write(reinterpret_cast<const char*>(&(*(row->begin()))),row->size());
-    }
+  write_rows(*this,out,PackBytes(),progress);
   out.close();
   return out;
 }
@@ -91,29 +392,15 @@ template <> bool Raster<uchar>::write_pgmfile(const std::string& filename,Progre
 template <> bool Raster<ushort>::write_pgmfile(const std::string& filename,Progress* target) const
 {
   ProgressScope progress(height(),"Writing PGM image:\n"+filename,target);
-  std::ofstream out(filename.c_str(),std::ios::binary);
+  AsyncOfstream out(filename,netpbm_header_size+2ULL*width()*height());
   out << "P5" << std::endl;
   out << width() << " " << height() << std::endl;
   const ushort m=maximum_scalar_pixel_value();
   out << m << std::endl;
-  for (ConstRowIterator row=row_begin();row!=row_end();++row)
-    {
-      progress.step();
-      for (const ushort* it=row->begin();it!=row->end();++it)
-    {
-      const uchar p[2]={((*it)>>8),(*it)};
-      if (m>=256)
-        {
-          // PGM spec is most significant byte first
-          out.write(reinterpret_cast<const char*>(p),2);
-        }
-      else
-        {
-          assert(p[0]==0);
-          out.write(reinterpret_cast<const char*>(p+1),1);
-        }
-    }
-    }
+  if (m>=256)
+    write_rows(*this,out,PackMSBFirst(),progress);
+  else
+    write_rows(*this,out,PackLowByte(),progress);
   out.close();
   return out;
 }
@@ -121,20 +408,83 @@ template <> bool Raster<ushort>::write_pgmfile(const std::string& filename,Progr
 template <> bool Raster<ByteRGBA>::write_ppmfile(const std::string& filename,Progress* target) const
 {
   ProgressScope progress(height(),"Writing PPM image:\n"+filename,target);
-  std::ofstream out(filename.c_str(),std::ios::binary);
+  AsyncOfstream out(filename,netpbm_header_size+3ULL*width()*height());
   out << "P6" << std::endl;
   out << width() << " " << height() << std::endl;
   out << "255" << std::endl;
-  for (ConstRowIterator row=row_begin();row!=row_end();++row)
-    {
-      progress.step();
-      for (const ByteRGBA* it=row->begin();it!=row->end();++it)
-    out.write(reinterpret_cast<const char*>(&((*it).r)),3);
-    }
+  write_rows(*this,out,PackRGB(),progress);
   out.close();
   return out;
 }
 
+template <typename T> RasterWriter<T>::RasterWriter(const std::string& filename,uint width,uint height,const ImageFormat& format)
+  :_out(filename,(format.png() ? 0 : netpbm_header_size+static_cast<unsigned long long>(PixelPacking<T>::Pack::bytes)*width*height))
+  ,_width(width)
+  ,_height(height)
+  ,_rows(0)
+  ,_maximum(0)
+  ,_format(format)
+  ,_adler(1)
+{
+  if (_format.png())
+    write_png_header(_out,width,height,PixelPacking<T>::png_bit_depth,PixelPacking<T>::png_colour_type,_format.png_compression());
+  else
+    write_netpbm_header<T>(_out,width,height,_maximum_position);
+}
+
+template <typename T> bool RasterWriter<T>::write(const Raster<T>& band)
+{
+  assert(band.width()==_width && _rows+band.height()<=_height);
+  typedef typename PixelPacking<T>::Pack Pack;
+  pack_rows(band,0,band.height(),_buffer,Pack());
+  bool ok=true;
+  if (_format.png())
+    ok=write_png_rows(_out,_buffer,Pack::bytes*_width,Pack::bytes,_format.png_compression(),_adler);
+  else
+    write_buffer(_out,_buffer);
+  _rows+=band.height();
+  return ok && _out;
+}
+
+template <> bool RasterWriter<ushort>::write(const Raster<ushort>& band)
+{
+  assert(band.width()==_width && _rows+band.height()<=_height);
+  pack_rows(band,0,band.height(),_buffer,PackMSBFirst());
+  bool ok=true;
+  if (_format.png())
+    {
+      ok=write_png_rows(_out,_buffer,2*_width,2,_format.png_compression(),_adler);
+    }
+  else
+    {
+      write_buffer(_out,_buffer);
+      if (band.height()) _maximum=std::max(_maximum,band.maximum_scalar_pixel_value());
+    }
+  _rows+=band.height();
+  return ok && _out;
+}
+
+template <typename T> bool RasterWriter<T>::close()
+{
+  if (_format.png()) write_png_end(_out,_adler);
+  _out.close();
+  return _out && _rows==_height;
+}
+
+template <> bool RasterWriter<ushort>::close()
+{
+  if (_format.png())
+    {
+      write_png_end(_out,_adler);
+    }
+  else
+    {
+      _out.seekp(_maximum_position);
+      _out << std::setw(5) << std::max(_maximum,static_cast<ushort>(256));
+    }
+  _out.close();
+  return _out && _rows==_height;
+}
 
 template class Raster<uchar>;
 template class Image<uchar>;
@@ -145,3 +495,7 @@ template class Image<ushort>;
 template class Raster<ByteRGBA>;
 template class Image<ByteRGBA>;
 
+template class RasterWriter<uchar>;
+template class RasterWriter<ushort>;
+template class RasterWriter<ByteRGBA>;
+
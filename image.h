@@ -24,6 +24,7 @@
 #ifndef _image_h_
 #define _image_h_
 
+#include "async_ofstream.h"
 #include "rgb.h"
 
 class Progress;
@@ -328,7 +329,9 @@ template <typename T> class Raster
   void scan(uint y,float x0,const ComputeType& v0,float x1,const ComputeType& v1);
 
   //! Variant scan, interpolates between two values then process them through function before
-  template <typename V> void scan(uint y,float x0,const V& v0,float x1,const V& v1,const boost::function<ComputeType (const V&)>& fn);
+  /*! The function is a template parameter (any functor or function pointer taking a V) so it can be inlined into the span loop.
+   */
+  template <typename V,typename F> void scan(uint y,float x0,const V& v0,float x1,const V& v1,F fn);
 
   bool write_ppmfile(const std::string&,Progress*) const;
   bool write_pgmfile(const std::string&,Progress*) const;
@@ -371,7 +374,7 @@ template <typename T> inline void Raster<T>::scan(uint y,float x0,const ComputeT
     }
 }
 
-template <typename T> template <typename V> inline void Raster<T>::scan(uint y,float x0,const V& v0,float x1,const V& v1,const boost::function<ComputeType (const V&)>& fn)
+template <typename T> template <typename V,typename F> inline void Raster<T>::scan(uint y,float x0,const V& v0,float x1,const V& v1,F fn)
 {
   assert(x0<=x1);
 
@@ -413,4 +416,97 @@ template <typename T> class Image : private ImageStorage<T>, public Raster<T>, p
     {}
 };
 
+//! File format for RasterWriter: Netpbm (PPM for ByteRGBA, PGM otherwise) or PNG.
+class ImageFormat
+{
+ public:
+
+  //! Constructor.  PNG compression is a zlib level, 0 (none) to 9 (best).
+  ImageFormat(bool png=false,uint png_compression=6)
+    :_png(png)
+    ,_png_compression(png_compression)
+    {}
+
+  bool png() const
+    {
+      return _png;
+    }
+
+  uint png_compression() const
+    {
+      return _png_compression;
+    }
+
+  //! File extension (without the dot) for images of pixel type T.
+  template <typename T> const char* extension() const
+    {
+      return (_png ? "png" : "pgm");
+    }
+
+ private:
+
+  bool _png;
+
+  uint _png_compression;
+};
+
+template <> inline const char* ImageFormat::extension<ByteRGBA>() const
+{
+  return (_png ? "png" : "ppm");
+}
+
+//! Writes an image file a band of rows at a time, so the whole image need never be in memory.
+/*! Netpbm output is as Raster::write_ppmfile and Raster::write_pgmfile would produce for the whole image,
+  except for 16-bit PGMs: the maximum value (which those use as the PGM maxval) isn't known until close(),
+  so it's left a fixed-width space in the header and filled in then.
+  For the same reason 16-bit samples are always written as two bytes, with maxval no less than 256.
+  PNG output is 8-bit RGB for ByteRGBA, 16-bit greyscale for ushort and 8-bit greyscale for uchar.
+  Each band is deflated as independent chunks of rows in parallel, which are stitched together into one zlib stream.
+  Assumes explicit instantiation.
+ */
+template <typename T> class RasterWriter : public boost::noncopyable
+{
+ public:
+
+  typedef typename PixelTraits<T>::ScalarType ScalarType;
+
+  //! Constructor.  Opens the file and writes the header.
+  RasterWriter(const std::string& filename,uint width,uint height,const ImageFormat& format=ImageFormat());
+
+  //! Destructor.
+  ~RasterWriter()
+    {}
+
+  //! Append the rows of a band (which must be the full width of the image).
+  bool write(const Raster<T>& band);
+
+  //! Finish the file.  Returns false if there were any errors, or not all rows were written.
+  bool close();
+
+ private:
+
+  AsyncOfstream _out;
+
+  const uint _width;
+
+  const uint _height;
+
+  //! Number of rows written so far.
+  uint _rows;
+
+  //! Largest value written so far.
+  ScalarType _maximum;
+
+  //! Where in the header the maximum value is to be written.
+  std::streampos _maximum_position;
+
+  //! Each band's packed file bytes, written in one go (kept to be reused by the next band).
+  std::vector<uchar> _buffer;
+
+  const ImageFormat _format;
+
+  //! Adler-32 checksum of the PNG image data deflated so far.
+  uint _adler;
+};
+
 #endif
@@ -0,0 +1,59 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Little-endian binary encoding (for file formats which require it, whatever this machine's byte order).
+*/
+
+#ifndef _little_endian_h_
+#define _little_endian_h_
+
+//! Store v at p little-endian.
+inline void store_little_endian(uchar* p,uint v)
+{
+  p[0]=v;
+  p[1]=v>>8;
+  p[2]=v>>16;
+  p[3]=v>>24;
+}
+
+//! Store v at p little-endian.
+inline void store_little_endian(uchar* p,ushort v)
+{
+  p[0]=v;
+  p[1]=v>>8;
+}
+
+//! Store v at p little-endian (IEEE single precision assumed, as everywhere fracplanet runs).
+inline void store_little_endian(uchar* p,float v)
+{
+  uint u;
+  std::memcpy(&u,&v,sizeof(u));
+  store_little_endian(p,u);
+}
+
+//! Append v to s little-endian.
+template <typename T> inline void append_little_endian(std::string& s,T v)
+{
+  uchar b[sizeof(T)];
+  store_little_endian(b,v);
+  s.append(reinterpret_cast<const char*>(b),sizeof(T));
+}
+
+#endif
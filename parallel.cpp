@@ -0,0 +1,116 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+#include "precompiled.h"
+
+#include "parallel.h"
+
+uint parallel_threads()
+{
+  return std::max(1u,boost::thread::hardware_concurrency());
+}
+
+namespace
+{
+  //! Hands out chunks of a parallel_for range to whichever thread asks next.
+  class ParallelForChunks : public boost::noncopyable
+  {
+  public:
+
+    ParallelForChunks(uint n,uint chunks,const boost::function<void (uint,uint)>& fn)
+      :_n(n)
+      ,_chunks(chunks)
+      ,_fn(fn)
+      ,_next(0)
+    {}
+
+    //! Process chunks until none remain, reporting progress after each if a callback is given.
+    void run(const boost::function<void (uint)>* progress)
+    {
+      for (;;)
+        {
+          uint c;
+          {
+            boost::mutex::scoped_lock lock(_mutex);
+            if (_next==_chunks) return;
+            c=_next++;
+          }
+
+          _fn(begin(c),begin(c+1));
+
+          if (progress && *progress)
+            {
+              uint claimed;
+              {
+                boost::mutex::scoped_lock lock(_mutex);
+                claimed=_next;
+              }
+              (*progress)((100*claimed)/_chunks);
+            }
+        }
+    }
+
+  private:
+
+    uint begin(uint c) const
+    {
+      return static_cast<uint>((static_cast<unsigned long long>(_n)*c)/_chunks);
+    }
+
+    const uint _n;
+
+    const uint _chunks;
+
+    const boost::function<void (uint,uint)>& _fn;
+
+    boost::mutex _mutex;
+
+    uint _next;
+  };
+}
+
+/*! Work is split into several chunks per thread so uneven chunks balance out.
+ */
+void parallel_for
+(
+ uint n,
+ const boost::function<void (uint,uint)>& fn,
+ const boost::function<void (uint)>& progress
+ )
+{
+  if (n==0) return;
+
+  const uint threads=std::min(n,parallel_threads());
+  if (threads==1)
+    {
+      fn(0,n);
+      if (progress) progress(100);
+      return;
+    }
+
+  ParallelForChunks chunks(n,std::min(n,8*threads),fn);
+
+  boost::thread_group workers;
+  for (uint t=1;t<threads;t++)
+    workers.create_thread(boost::bind(&ParallelForChunks::run,&chunks,static_cast<const boost::function<void (uint)>*>(0)));
+
+  chunks.run(&progress);
+
+  workers.join_all();
+}
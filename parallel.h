@@ -0,0 +1,42 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Interface for parallel loop helpers.
+*/
+
+#ifndef _parallel_h_
+#define _parallel_h_
+
+//! Number of threads parallel_for will use (one per core).
+extern uint parallel_threads();
+
+//! Invoke fn(begin,end) concurrently on contiguous sub-ranges covering [0,n).
+/*! The calling thread takes a share of the work and is the only one to invoke progress
+  (with a percentage complete), so Progress implementations need not be thread-safe.
+  fn must be safe to run concurrently on disjoint ranges.
+ */
+extern void parallel_for
+(
+ uint n,
+ const boost::function<void (uint,uint)>& fn,
+ const boost::function<void (uint)>& progress=boost::function<void (uint)>()
+ );
+
+#endif
@@ -24,9 +24,27 @@
 ParametersSave::ParametersSave(const ParametersRender* pr)
   :pov_atmosphere(false)
   ,pov_sea_object(true)
+  ,pov_palette(false)
+  ,pov_palette_bits(8)
   ,blender_per_vertex_alpha(false)
+  ,gltf_quantise(false)
+  ,mesh_obj(false)
+  ,all_pov(true)
+  ,all_blender(true)
+  ,all_gltf(false)
+  ,all_mesh(false)
+  ,all_texture(true)
+  ,decimate(false)
+  ,decimate_triangles(100000)
+  ,decimate_error(0.0f)
   ,texture_shaded(false)
   ,texture_height(1024)
+  ,texture_png(false)
+  ,texture_png_compression(6)
+  ,texture_dem_mesh(false)
+  ,texture_cube_map(false)
+  ,texture_tiled(false)
+  ,texture_tile_size(256)
   ,parameters_render(pr)
 {}
 
@@ -43,15 +43,69 @@ class ParametersSave
   //! Whether to emit a single sea-level object to POV file.
   bool pov_sea_object;
 
+  //! Whether to write a palette of the distinct vertex colours to the POV file, rather than a texture per vertex.
+  bool pov_palette;
+
+  //! Bits per colour channel (1-8) the POV palette's colours are quantised to.
+  uint pov_palette_bits;
+
   //! Whether to try using per-vertex-alpha in the blender output.
   bool blender_per_vertex_alpha;
 
+  //! Whether to quantise glTF vertex attributes (positions to shorts, normals to bytes).
+  bool gltf_quantise;
+
+  //! Whether meshes (and DEM meshes) are saved as ASCII OBJ, rather than binary PLY.
+  bool mesh_obj;
+
+  //! Whether saving all selected formats at once includes POV-Ray files.
+  bool all_pov;
+
+  //! Whether saving all selected formats at once includes Blender files.
+  bool all_blender;
+
+  //! Whether saving all selected formats at once includes a glTF file.
+  bool all_gltf;
+
+  //! Whether saving all selected formats at once includes PLY/OBJ files.
+  bool all_mesh;
+
+  //! Whether saving all selected formats at once includes textures.
+  bool all_texture;
+
+  //! Whether to decimate terrain meshes before exporting them (to POV-Ray, Blender, glTF, PLY or OBJ).
+  bool decimate;
+
+  //! Triangle budget for decimated meshes (0 for no budget).
+  uint decimate_triangles;
+
+  //! Error tolerance for decimated meshes, relative to the nominal radius of 1.0 (0 for no limit).
+  float decimate_error;
+
   //! Whether textures should include shading.
   bool texture_shaded;
 
   //! Size of texture for texture save (is height; width is implicit).
   uint texture_height;
 
+  //! Whether textures are saved as PNG, rather than PPM/PGM, images.
+  bool texture_png;
+
+  //! zlib compression level (0-9) for PNG textures.
+  uint texture_png_compression;
+
+  //! Whether texture save also saves the DEM as a grid mesh (PLY or OBJ, as mesh_obj).
+  bool texture_dem_mesh;
+
+  //! Whether planets' textures are saved as the six faces of a cube map, rather than as a single equirectangular image.
+  bool texture_cube_map;
+
+  //! Whether textures are saved as a pyramid of tiles at successively halved resolutions, rather than as single images.
+  bool texture_tiled;
+
+  //! Width and height of each tile of a tiled texture.
+  uint texture_tile_size;
+
   //! Save for blender needs access to some of these.
   const ParametersRender*const parameters_render;
 };
@@ -29,6 +29,7 @@ ParametersTerrain::ParametersTerrain()
    ,variation(0.0,0.0,0.125)
    ,noise(0)
    ,base_height(0)
+   ,simplify_oceans(true)
    ,power_law(1.5)
    ,snowline_equator(0.8)
    ,snowline_pole(-0.1)
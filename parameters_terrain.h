@@ -53,6 +53,9 @@ public:
   //! Initial height of unsubdivided, unperturbed terrain, expressed as a proportion of variation.z
   float base_height;
 
+  //! Whether to merge all-sea regions into coarser triangles after sea level is imposed.
+  bool simplify_oceans;
+
   //! Power law applied to terrain heights.
   /*! When >1, flattens low areas.  When <1, flattens highland areas and creates gorges.
    */
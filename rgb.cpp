@@ -25,6 +25,8 @@
 
 #include "rgb.h"
 
+#include "text_format.h"
+
 std::ostream& ByteRGBA::write(std::ostream& out) const
 {
   return out << static_cast<uint>(r) << " " << static_cast<uint>(g) << " " << static_cast<uint>(b) << " " << static_cast<uint>(a);
@@ -44,14 +46,38 @@ std::ostream& FloatRGBA::write(std::ostream& out) const
 
 const std::string FloatRGBA::format_pov_rgb() const
 {
-  std::ostringstream s;
-  s << "<" << r << "," << g << "," << b << ">";
-  return s.str();
+  std::string s;
+  append_pov_rgb(s);
+  return s;
 }
 
 const std::string FloatRGBA::format_pov_rgbf() const
 {
-  std::ostringstream s;
-  s << "<" << r << "," << g << "," << b << "," << 1.0f-a << ">";
-  return s.str();
+  std::string s;
+  append_pov_rgbf(s);
+  return s;
+}
+
+void FloatRGBA::append_pov_rgb(std::string& s) const
+{
+  s+='<';
+  append_number(s,r);
+  s+=',';
+  append_number(s,g);
+  s+=',';
+  append_number(s,b);
+  s+='>';
+}
+
+void FloatRGBA::append_pov_rgbf(std::string& s) const
+{
+  s+='<';
+  append_number(s,r);
+  s+=',';
+  append_number(s,g);
+  s+=',';
+  append_number(s,b);
+  s+=',';
+  append_number(s,1.0f-a);
+  s+='>';
 }
@@ -203,6 +203,12 @@ public:
   const std::string format_pov_rgb() const;
 
   const std::string format_pov_rgbf() const;
+
+  //! As format_pov_rgb, but appended to s (without the overhead of a stream).
+  void append_pov_rgb(std::string& s) const;
+
+  //! As format_pov_rgbf, but appended to s (without the overhead of a stream).
+  void append_pov_rgbf(std::string& s) const;
 };
 
 //! Colour multiplication-by-scalar operator.
@@ -50,29 +50,16 @@ class ScanEdge
   float lambda;
 };
 
-class ScanConvertBackend;
-
-class ScanConverter
-{
- public:
-
-  ScanConverter()
-    {}
-
-  virtual ~ScanConverter()
-    {}
-
-  //! Set-up for scan conversion of given vertices to the given map.
-  /* Scan conversion output is a series of [,) open intervals with vertex identifiers and weightings for each end.
-   */
-  virtual void scan_convert
-    (
-     const boost::array<XYZ,3>& v,
-     const ScanConvertBackend&
-     ) const
-    =0;
-};
-
+//! Base for scan-conversion backends.
+/*! Geometry scan_convert methods are templates over the backend type, so a backend is any class
+  (conventionally derived from this one, for its dimensions) also providing
+  - void scan_convert_backend(uint y,const ScanEdge& edge0,const ScanEdge& edge1) const,
+    called for each span of a triangle (edge0 left of edge1) in scanline y;
+  - template <class C> void subdivide(const boost::array<XYZ,3>& v,const XYZ& m,const boost::array<float,3>& w,const C& scan_converter) const,
+    called when a triangle must be split at point m (e.g a pole), with barycentric weights w:
+    each of the three triangles (v[i],v[(i+1)%3],m), with attributes at m interpolated by w, is passed back to scan_converter.scan_convert.
+  Backend calls are resolved at compile time, so per-span work (and the Raster::scan loops within it) can be inlined.
+*/
 class ScanConvertBackend
 {
  public:
@@ -82,9 +69,6 @@ class ScanConvertBackend
     ,_height(h)
     {}
 
-  virtual ~ScanConvertBackend()
-    {}
-
   int width() const
     {
       return _width;
@@ -95,11 +79,11 @@ class ScanConvertBackend
       return _height;
     }
 
-  virtual void scan_convert_backend(uint y,const ScanEdge& edge0,const ScanEdge& edge1) const
-    =0;
+ protected:
 
-  virtual void subdivide(const boost::array<XYZ,3>&,const XYZ&,const ScanConverter&) const
-    =0;
+  //! Protected (and non-virtual) as backends are never used polymorphically.
+  ~ScanConvertBackend()
+    {}
 
  private:
 
@@ -108,4 +92,50 @@ class ScanConvertBackend
   const int _height;
 };
 
+//! Generic scan-conversion backend, interpolating a per-vertex attribute tuple A over each triangle.
+/*! A can be anything supporting A+A and float*A: a float, a FloatRGBA, or a class aggregating several attributes.
+  Target T supplies the map's width() and height(), whether it draws(y) scanline y at all,
+  and scan(y,x0,a0,x1,a1) to draw a span with the interpolated end values.
+ */
+template <class A,class T> class ScanConvertHelper : public ScanConvertBackend
+{
+ public:
+
+  ScanConvertHelper(const T& target,const boost::array<A,3>& vertex_attributes)
+    :ScanConvertBackend(target.width(),target.height())
+    ,_target(target)
+    ,_vertex_attributes(vertex_attributes)
+    {}
+
+  void scan_convert_backend(uint y,const ScanEdge& edge0,const ScanEdge& edge1) const
+    {
+      if (_target.draws(y))
+        _target.scan(y,edge0.x,interpolate(edge0),edge1.x,interpolate(edge1));
+    }
+
+  template <class C> void subdivide(const boost::array<XYZ,3>& v,const XYZ& m,const boost::array<float,3>& w,const C& scan_converter) const
+    {
+      const A am=w[0]*_vertex_attributes[0]+w[1]*_vertex_attributes[1]+w[2]*_vertex_attributes[2];
+      for (uint i=0;i<3;i++)
+        {
+          const uint j=(i+1)%3;
+          const boost::array<XYZ,3> p={{v[i],v[j],m}};
+          const boost::array<A,3> a={{_vertex_attributes[i],_vertex_attributes[j],am}};
+          scan_converter.scan_convert(p,ScanConvertHelper(_target,a));
+        }
+    }
+
+ private:
+
+  //! Attributes at the point where a scanline crosses an edge.
+  const A interpolate(const ScanEdge& edge) const
+    {
+      return (1.0f-edge.lambda)*_vertex_attributes[edge.vertex0]+edge.lambda*_vertex_attributes[edge.vertex1];
+    }
+
+  const T& _target;
+
+  const boost::array<A,3>& _vertex_attributes;
+};
+
 #endif
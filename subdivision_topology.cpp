@@ -0,0 +1,169 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+#include "precompiled.h"
+
+#include "subdivision_topology.h"
+
+#include "triangle_edge.h"
+
+uint SubdivisionTopology::boundary_edges(const std::vector<Triangle>& triangles)
+{
+  typedef std::map<TriangleEdge,uint> EdgeCount;
+  EdgeCount edge_count;
+  for (uint t=0;t<triangles.size();t++)
+    for (uint e=0;e<3;e++)
+      edge_count[TriangleEdge(triangles[t].vertex(e),triangles[t].vertex((e+1)%3))]++;
+
+  uint boundary=0;
+  for (EdgeCount::const_iterator it=edge_count.begin();it!=edge_count.end();it++)
+    if ((*it).second==1) boundary++;
+  return boundary;
+}
+
+SubdivisionTopology::SubdivisionTopology(uint base_vertices,const std::vector<Triangle>& base_triangles,uint levels)
+  :_base_vertices(base_vertices)
+  ,_base_triangles(base_triangles)
+  ,_midpoints(levels)
+  ,_vertices(base_vertices)
+{
+  // This must match the vertex numbering and triangle ordering of TriangleMesh::subdivide exactly:
+  // each triangle (i0,i1,i2) becomes (i0,m01,m20),(m01,i1,m12),(m20,m12,i2),(m01,m12,m20),
+  // with the midpoints of edges 01, 12 and 20 numbered in the order they're first met.
+
+  const uint base_boundary=boundary_edges(base_triangles);
+  const uint final_triangles=triangles_after(base_triangles.size(),levels);
+  const uint last_vertices=(levels ? vertices_after(base_vertices,base_triangles.size(),base_boundary,levels-1) : base_vertices);
+  const uint last_triangles=(levels ? triangles_after(base_triangles.size(),levels-1) : 0);
+
+  // Two triangle arenas, sized for the last two levels and used alternately as source and destination,
+  // arranged so that the last level's output lands in the larger.
+  boost::array<std::vector<Triangle>,2> arena;
+  arena[0].reserve(final_triangles);
+  arena[1].reserve(std::max(last_triangles,static_cast<uint>(base_triangles.size())));
+  arena[levels%2 ? 1 : 0]=base_triangles;
+
+  // Midpoints found so far of edges whose lower-numbered vertex is v are
+  // slot[slot_begin[v]] to slot[slot_end[v]-1], as (other vertex,midpoint) pairs.
+  // Each triangle edge is given a slot under its lower vertex, so there is always room.
+  std::vector<uint> slot_begin;
+  std::vector<uint> slot_end;
+  std::vector<std::pair<uint,uint> > slot;
+  slot_begin.reserve(last_vertices+1);
+  slot_end.reserve(last_vertices);
+  slot.reserve(3*last_triangles);
+
+  for (uint level=0;level<levels;level++)
+    {
+      const uint dst=(levels-1-level)%2;
+      const std::vector<Triangle>& old_triangles=arena[1-dst];
+      std::vector<Triangle>& new_triangles=arena[dst];
+      new_triangles.clear();
+
+      slot_begin.assign(_vertices+1,0);
+      for (uint t=0;t<old_triangles.size();t++)
+        for (uint e=0;e<3;e++)
+          slot_begin[1+std::min(old_triangles[t].vertex(e),old_triangles[t].vertex((e+1)%3))]++;
+      std::partial_sum(slot_begin.begin(),slot_begin.end(),slot_begin.begin());
+      slot_end.assign(slot_begin.begin(),slot_begin.end()-1);
+      slot.resize(3*old_triangles.size());
+
+      std::vector<std::pair<uint,uint> >& midpoints=_midpoints[level];
+      midpoints.reserve(edges(old_triangles.size(),base_boundary<<level));
+
+      for (uint t=0;t<old_triangles.size();t++)
+        {
+          boost::array<uint,3> i;
+          boost::array<uint,3> m;
+          for (uint e=0;e<3;e++)
+            i[e]=old_triangles[t].vertex(e);
+
+          for (uint e=0;e<3;e++)
+            {
+              const uint a=i[e];
+              const uint b=i[(e+1)%3];
+              const uint lo=std::min(a,b);
+              const uint hi=std::max(a,b);
+
+              uint s=slot_begin[lo];
+              while (s<slot_end[lo] && slot[s].first!=hi) s++;
+              if (s==slot_end[lo])
+                {
+                  slot[slot_end[lo]++]=std::make_pair(hi,_vertices++);
+                  midpoints.push_back(std::make_pair(a,b));
+                }
+              m[e]=slot[s].second;
+            }
+
+          new_triangles.push_back(Triangle(i[0],m[0],m[2]));
+          new_triangles.push_back(Triangle(m[0],i[1],m[1]));
+          new_triangles.push_back(Triangle(m[2],m[1],i[2]));
+          new_triangles.push_back(Triangle(m[0],m[1],m[2]));
+        }
+    }
+
+  _triangles.swap(arena[0]);
+
+  assert(_triangles.size()==final_triangles);
+  assert(_vertices==vertices_after(base_vertices,base_triangles.size(),base_boundary,levels));
+}
+
+SubdivisionTopology::~SubdivisionTopology()
+{}
+
+namespace
+{
+  //! Key identifying a subdivision topology: base vertex count, levels, then flattened base triangle indices.
+  typedef std::vector<uint> TopologyKey;
+
+  typedef std::map<TopologyKey,boost::weak_ptr<const SubdivisionTopology> > TopologyCache;
+
+  boost::mutex topology_cache_mutex;
+  TopologyCache topology_cache;
+}
+
+boost::shared_ptr<const SubdivisionTopology> SubdivisionTopology::shared(uint base_vertices,const std::vector<Triangle>& base_triangles,uint levels)
+{
+  TopologyKey key;
+  key.reserve(2+3*base_triangles.size());
+  key.push_back(base_vertices);
+  key.push_back(levels);
+  for (uint t=0;t<base_triangles.size();t++)
+    for (uint i=0;i<3;i++)
+      key.push_back(base_triangles[t].vertex(i));
+
+  boost::mutex::scoped_lock lock(topology_cache_mutex);
+
+  // Drop entries for topologies nobody uses any more.
+  for (TopologyCache::iterator it=topology_cache.begin();it!=topology_cache.end();)
+    {
+      if ((*it).second.expired())
+        topology_cache.erase(it++);
+      else
+        ++it;
+    }
+
+  boost::shared_ptr<const SubdivisionTopology> topology=topology_cache[key].lock();
+  if (!topology)
+    {
+      topology.reset(new SubdivisionTopology(base_vertices,base_triangles,levels));
+      topology_cache[key]=topology;
+    }
+  return topology;
+}
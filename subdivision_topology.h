@@ -0,0 +1,139 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Interface for class SubdivisionTopology.
+*/
+
+#ifndef _subdivision_topology_h_
+#define _subdivision_topology_h_
+
+#include "triangle.h"
+
+//! The connectivity resulting from repeatedly subdividing a base mesh, independent of any vertex positions.
+/*! TriangleMesh::subdivide numbers new vertices and orders new triangles purely by the existing triangle order,
+  so every mesh subdivided from the same base triangles the same number of times has an identical triangle array,
+  and appends midpoints of the same edges in the same order.
+  Recording that once lets those meshes skip building an edge-to-midpoint map,
+  and only compute their (possibly perturbed) vertex positions.
+  Instances are immutable once constructed, and so can safely be shared between meshes.
+
+  Counts follow in closed form from the base mesh's vertices V, triangles T and boundary edges B:
+  after s subdivisions there are T*4^s triangles, B*2^s boundary edges
+  and V+(T*(4^s-1)+B*(2^s-1))/2 vertices (10*4^s+2 for an icosahedron),
+  and the pass from level s to s+1 adds one midpoint per edge, (3*T*4^s+B*2^s)/2 of them.
+  All storage is reserved exactly from these, so nothing is reallocated while building.
+  Building s levels peaks (during the last pass) at about
+  12*(T_s+T_(s-1)) bytes for two triangle arenas, 8*(V_s-V) for the midpoint lists,
+  and 24*T_(s-1)+8*V_(s-1) for the edge-to-midpoint slots,
+  where T_s and V_s are the counts at level s; for an icosahedron that's roughly 470*4^s bytes.
+  The topology then retains 12*T_s+8*(V_s-V) bytes (roughly 320*4^s for an icosahedron),
+  and a mesh subdivided with it adds its own 32*V_s (vertices) plus 12*T_s (triangles).
+ */
+class SubdivisionTopology : public boost::noncopyable
+{
+ public:
+
+  //! Constructor.  Subdivides the base triangles (which reference vertices 0 to base_vertices-1) levels times.
+  SubdivisionTopology(uint base_vertices,const std::vector<Triangle>& base_triangles,uint levels);
+
+  //! Destructor.
+  ~SubdivisionTopology();
+
+  //! Return a topology for the given base mesh and levels, shared with any other holder still using one.
+  /*! Only weak references are cached, so a topology is freed when the last mesh using it releases it.
+   */
+  static boost::shared_ptr<const SubdivisionTopology> shared(uint base_vertices,const std::vector<Triangle>& base_triangles,uint levels);
+
+  //! Number of triangles after levels subdivisions of the given number.
+  static uint triangles_after(uint triangles,uint levels)
+    {
+      return triangles<<(2*levels);
+    }
+
+  //! Number of vertices after levels subdivisions of a mesh with the given numbers of vertices, triangles and boundary edges.
+  static uint vertices_after(uint vertices,uint triangles,uint boundary_edges,uint levels)
+    {
+      return vertices+(triangles*((1u<<(2*levels))-1)+boundary_edges*((1u<<levels)-1))/2;
+    }
+
+  //! Number of distinct edges in a mesh with the given numbers of triangles and boundary edges.
+  static uint edges(uint triangles,uint boundary_edges)
+    {
+      return (3*triangles+boundary_edges)/2;
+    }
+
+  //! Number of edges used by only one of the triangles.
+  static uint boundary_edges(const std::vector<Triangle>& triangles);
+
+  //! Number of vertices before subdivision.
+  uint base_vertices() const
+    {
+      return _base_vertices;
+    }
+
+  //! The triangles before subdivision.
+  const std::vector<Triangle>& base_triangles() const
+    {
+      return _base_triangles;
+    }
+
+  //! Number of subdivision passes.
+  uint levels() const
+    {
+      return _midpoints.size();
+    }
+
+  //! The edges (as pairs of vertex indices) whose midpoints subdivision pass level appends, in order.
+  const std::vector<std::pair<uint,uint> >& midpoints(uint level) const
+    {
+      return _midpoints[level];
+    }
+
+  //! Number of vertices after all the subdivision passes.
+  uint vertices() const
+    {
+      return _vertices;
+    }
+
+  //! The triangles after all the subdivision passes.
+  const std::vector<Triangle>& triangles() const
+    {
+      return _triangles;
+    }
+
+ private:
+
+  //! Number of vertices before subdivision.
+  const uint _base_vertices;
+
+  //! Triangles before subdivision.
+  const std::vector<Triangle> _base_triangles;
+
+  //! Midpoint edges added by each pass.
+  std::vector<std::vector<std::pair<uint,uint> > > _midpoints;
+
+  //! Number of vertices after all the subdivision passes.
+  uint _vertices;
+
+  //! Final triangles.
+  std::vector<Triangle> _triangles;
+};
+
+#endif
@@ -0,0 +1,155 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Implementation of fast text formatting of numbers, and parallel formatting of large outputs.
+*/
+
+#include "precompiled.h"
+
+#include "text_format.h"
+
+#include "parallel.h"
+#include "progress.h"
+
+void append_number(std::string& s,uint v)
+{
+  char digits[10];
+  uint n=0;
+  do
+    {
+      digits[n++]='0'+v%10;
+      v/=10;
+    }
+  while (v);
+  while (n) s+=digits[--n];
+}
+
+/*! The float is rounded to 6 significant figures by scaling it (as a double) by a power of ten to between 100000 and 999999.
+  For exponents -7 to 5 that power is an integer of at most 29 bits, so with the float's 24 bit mantissa the product is exact,
+  and rounding it to an integer (half to even, as glibc's printf does with exact ties) gives exactly printf's digits.
+  Those are then laid out as %g does: fixed point for exponents -4 to 5, otherwise exponential, without trailing zeros.
+*/
+void append_number(std::string& s,float v)
+{
+  static const double powers_of_ten[13]={1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,1e12};
+
+  if (v==0.0f)
+    {
+      s+=(signbit(v) ? "-0" : "0");
+      return;
+    }
+
+  const double a=fabs(static_cast<double>(v));
+  int e=-8;
+  if (a>=1e-7 && a<1e6)
+    {
+      e=static_cast<int>(floor(log10(a)));
+      // log10 may be out by one near powers of ten, but the exact scaled value shows which way.
+      if (e>=-7 && e<=5)
+        {
+          if (a*powers_of_ten[5-e]<1e5) e--;
+          else if (a*powers_of_ten[5-e]>=1e6) e++;
+        }
+    }
+  if (e<-7 || e>5)
+    {
+      char buffer[32];
+      snprintf(buffer,sizeof(buffer),"%g",static_cast<double>(v));
+      s+=buffer;
+      return;
+    }
+
+  uint m=static_cast<uint>(nearbyint(a*powers_of_ten[5-e]));
+  if (m==1000000)
+    {
+      m=100000;
+      e++;
+    }
+
+  char digits[6];
+  for (int i=5;i>=0;i--)
+    {
+      digits[i]='0'+m%10;
+      m/=10;
+    }
+  int significant=6;
+  while (digits[significant-1]=='0') significant--;
+
+  if (v<0.0f) s+='-';
+  if (e<-4 || e>=6)
+    {
+      s+=digits[0];
+      if (significant>1)
+        {
+          s+='.';
+          s.append(digits+1,significant-1);
+        }
+      s+=(e<0 ? "e-" : "e+");
+      const int x=std::abs(e);
+      if (x<10) s+='0';
+      append_number(s,static_cast<uint>(x));
+    }
+  else if (e>=0)
+    {
+      const int integer=e+1;
+      s.append(digits,std::min(significant,integer));
+      for (int i=significant;i<integer;i++) s+='0';
+      if (significant>integer)
+        {
+          s+='.';
+          s.append(digits+integer,significant-integer);
+        }
+    }
+  else
+    {
+      s+="0.";
+      for (int i=0;i<-e-1;i++) s+='0';
+      s.append(digits,significant);
+    }
+}
+
+namespace
+{
+  //! Formats chunks [begin,end) of a range of elements into their own strings, for parallel_for.
+  void format_chunks(const boost::function<void (std::string&,uint,uint)>& format,uint first,uint n,uint chunk,std::vector<std::string>& text,uint begin,uint end)
+  {
+    for (uint c=begin;c<end;c++)
+      {
+        text[c].clear();
+        const uint b=first+c*chunk;
+        if (b<n) format(text[c],b,std::min(n,b+chunk));
+      }
+  }
+}
+
+/*! Each chunk's string is reused by the corresponding chunk of the next batch.
+ */
+void write_formatted(std::ostream& out,uint n,const boost::function<void (std::string&,uint,uint)>& format,Progress* progress,uint step,uint steps)
+{
+  const uint chunk=4096;
+  std::vector<std::string> text(4*parallel_threads());
+  for (uint first=0;first<n;first+=chunk*text.size())
+    {
+      parallel_for(text.size(),boost::bind(&format_chunks,boost::cref(format),first,n,chunk,boost::ref(text),_1,_2));
+      for (uint c=0;c<text.size();c++)
+        if (!text[c].empty()) out.write(text[c].data(),text[c].size());
+      if (progress) progress->progress_step((100ULL*(step+std::min(n,first+chunk*static_cast<uint>(text.size()))))/steps);
+    }
+}
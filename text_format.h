@@ -0,0 +1,45 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Interface for fast text formatting of numbers, and parallel formatting of large outputs.
+*/
+
+#ifndef _text_format_h_
+#define _text_format_h_
+
+//! Append v to s as std::ostream's operator<< would (with default flags).
+extern void append_number(std::string& s,uint v);
+
+//! Append v to s exactly as std::ostream's operator<< would with default flags and precision (printf's %g).
+/*! Most values are formatted directly, several times faster than going through a stream;
+  anything this can't format exactly (very large or small magnitudes, infinities and NaNs) falls back to snprintf.
+ */
+extern void append_number(std::string& s,float v);
+
+class Progress;
+
+//! Write n elements to out, formatting chunks of them in parallel with format(s,begin,end) (which appends to s).
+/*! Chunks are formatted a batch (a few per thread) at a time and written in order, one write per chunk,
+  so the text in memory at any time is bounded whatever n is.
+  After each batch, progress (if not null) is stepped to the percentage of steps reached, the elements being steps from step to step+n.
+ */
+extern void write_formatted(std::ostream& out,uint n,const boost::function<void (std::string&,uint,uint)>& format,Progress* progress,uint step,uint steps);
+
+#endif
@@ -0,0 +1,32 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+#include "precompiled.h"
+
+#include "texture_renderer.h"
+
+TerrainTextureLayer::TerrainTextureLayer(const TriangleMesh& mesh,const std::vector<float>& heights,bool shading,float ambient,const XYZ& illumination)
+  :_mesh(mesh)
+  ,_heights(heights)
+  ,_shade(mesh.vertices(),1.0f)
+{
+  if (shading)
+    for (uint i=0;i<mesh.vertices();i++)
+      _shade[i]=ambient+(1.0f-ambient)*std::max(0.0f,mesh.vertex(i).normal()%illumination);
+}
@@ -0,0 +1,467 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Interface for class TextureRenderer and the texture layers it renders.
+*/
+
+#ifndef _texture_renderer_h_
+#define _texture_renderer_h_
+
+#include "image.h"
+#include "parallel.h"
+#include "scan.h"
+#include "triangle_mesh.h"
+
+//! The rows of a width by height texture held by a set of rasters, and the subset of those to be drawn.
+/*! The rasters hold texture rows from first_row on (not necessarily the whole texture), and only rows [row_begin,row_end) are drawn.
+ */
+class TextureRows
+{
+ public:
+
+  TextureRows(uint width,uint height,uint first_row,uint row_begin,uint row_end)
+    :_width(width)
+    ,_height(height)
+    ,_first_row(first_row)
+    ,_row_begin(row_begin)
+    ,_row_end(row_end)
+    {}
+
+  uint width() const
+    {
+      return _width;
+    }
+
+  uint height() const
+    {
+      return _height;
+    }
+
+  uint row_begin() const
+    {
+      return _row_begin;
+    }
+
+  uint row_end() const
+    {
+      return _row_end;
+    }
+
+  //! Whether texture row y is drawn.
+  bool draws(uint y) const
+    {
+      return (_row_begin<=y && y<_row_end);
+    }
+
+  //! Draw no more than raster rows [begin,end).
+  void clip(uint begin,uint end)
+    {
+      _row_begin=std::max(_row_begin,_first_row+begin);
+      _row_end=std::min(_row_end,_first_row+end);
+    }
+
+ protected:
+
+  //! Raster row holding texture row y.
+  uint row(uint y) const
+    {
+      return y-_first_row;
+    }
+
+ private:
+
+  uint _width;
+  uint _height;
+  uint _first_row;
+  uint _row_begin;
+  uint _row_end;
+};
+
+//! Attributes of terrain interpolated across a texture: colour, height (scaled for a 16-bit DEM) and normal.
+class TerrainTexel
+{
+ public:
+
+  TerrainTexel()
+    {}
+
+  TerrainTexel(const FloatRGBA& c,float h,const XYZ& n)
+    :colour(c)
+    ,height(h)
+    ,normal(n)
+    {}
+
+  FloatRGBA colour;
+  float height;
+  XYZ normal;
+};
+
+inline const TerrainTexel operator+(const TerrainTexel& a,const TerrainTexel& b)
+{
+  return TerrainTexel(a.colour+b.colour,a.height+b.height,a.normal+b.normal);
+}
+
+inline const TerrainTexel operator*(float k,const TerrainTexel& t)
+{
+  return TerrainTexel(k*t.colour,k*t.height,k*t.normal);
+}
+
+//! Encodes an interpolated normal as a normal-map colour.
+class NormalColour
+{
+ public:
+
+  FloatRGBA operator()(const XYZ& v) const
+    {
+      const XYZ n(v.normalised());
+      return FloatRGBA(0.5f+0.5f*n.x,0.5f+0.5f*n.y,0.5f+0.5f*n.z,0.0f);
+    }
+};
+
+//! Draws TerrainTexels into a colour texture and, optionally, a DEM and a normal map.
+class TerrainTextureTarget : public TextureRows
+{
+ public:
+
+  TerrainTextureTarget(const TextureRows& rows,Raster<ByteRGBA>& image,Raster<ushort>* dem,Raster<ByteRGBA>* normal_map)
+    :TextureRows(rows)
+    ,_image(image)
+    ,_dem(dem)
+    ,_normal_map(normal_map)
+    {
+      if (_dem) assert(_image.width()==_dem->width() && _image.height()==_dem->height());
+      if (_normal_map) assert(_image.width()==_normal_map->width() && _image.height()==_normal_map->height());
+    }
+
+  void scan(uint y,float x0,const TerrainTexel& t0,float x1,const TerrainTexel& t1) const
+    {
+      const uint r=row(y);
+      _image.scan(r,x0,t0.colour,x1,t1.colour);
+      if (_dem) _dem->scan(r,x0,t0.height,x1,t1.height);
+      if (_normal_map) _normal_map->scan(r,x0,t0.normal.normalised(),x1,t1.normal.normalised(),NormalColour());
+    }
+
+ private:
+
+  Raster<ByteRGBA>& _image;
+  Raster<ushort>*const _dem;
+  Raster<ByteRGBA>*const _normal_map;
+};
+
+//! Draws cloud alpha (0 to 255) into a greyscale raster.
+class CloudTextureTarget : public TextureRows
+{
+ public:
+
+  CloudTextureTarget(const TextureRows& rows,Raster<uchar>& image)
+    :TextureRows(rows)
+    ,_image(image)
+    {}
+
+  void scan(uint y,float x0,float a0,float x1,float a1) const
+    {
+      _image.scan(row(y),x0,a0,x1,a1);
+    }
+
+ private:
+
+  Raster<uchar>& _image;
+};
+
+//! What a TextureRenderer needs to know to texture a terrain mesh.
+/*! Like all layers, provides the mesh, the Attribute type interpolated, the Target type drawing them,
+  and the attributes of each triangle's vertices.
+ */
+class TerrainTextureLayer
+{
+ public:
+
+  typedef TerrainTexel Attribute;
+  typedef TerrainTextureTarget Target;
+
+  //! Constructor.  Heights are normalised (to be scaled to the 16-bit DEM range); vertex colours are optionally shaded.
+  TerrainTextureLayer(const TriangleMesh& mesh,const std::vector<float>& heights,bool shading,float ambient,const XYZ& illumination);
+
+  const TriangleMesh& mesh() const
+    {
+      return _mesh;
+    }
+
+  void attributes(uint i,boost::array<TerrainTexel,3>& a) const
+    {
+      const Triangle& t=_mesh.triangle(i);
+      const uint which_colour=(i<_mesh.triangles_of_colour0() ? 0 : 1);
+      for (uint j=0;j<3;j++)
+        {
+          const uint v=t.vertex(j);
+          const Vertex& vertex=_mesh.vertex(v);
+          a[j]=TerrainTexel
+            (
+             FloatRGBA(vertex.colour(which_colour))*_shade[v],
+             std::max(0.0f,std::min(65535.0f,65535.0f*_heights[v])),
+             vertex.normal()
+             );
+        }
+    }
+
+ private:
+
+  const TriangleMesh& _mesh;
+  const std::vector<float>& _heights;
+
+  //! Shading factor for each vertex's colour.
+  std::vector<float> _shade;
+};
+
+//! What a TextureRenderer needs to know to render a cloud mesh's alpha.
+class CloudTextureLayer
+{
+ public:
+
+  typedef float Attribute;
+  typedef CloudTextureTarget Target;
+
+  CloudTextureLayer(const TriangleMesh& mesh)
+    :_mesh(mesh)
+    {}
+
+  const TriangleMesh& mesh() const
+    {
+      return _mesh;
+    }
+
+  void attributes(uint i,boost::array<float,3>& a) const
+    {
+      const Triangle& t=_mesh.triangle(i);
+      for (uint j=0;j<3;j++)
+        a[j]=_mesh.vertex(t.vertex(j)).colour(0).a;
+    }
+
+ private:
+
+  const TriangleMesh& _mesh;
+};
+
+//! Scan-converts nothing, but widens extent to include every row a triangle touches.
+class RowExtentHelper : public ScanConvertBackend
+{
+ public:
+
+  RowExtentHelper(uint width,uint height,std::pair<uint,uint>& extent)
+    :ScanConvertBackend(width,height)
+    ,_extent(extent)
+    {}
+
+  void scan_convert_backend(uint y,const ScanEdge&,const ScanEdge&) const
+    {
+      _extent.first=std::min(_extent.first,y);
+      _extent.second=std::max(_extent.second,y+1);
+    }
+
+  template <class C> void subdivide(const boost::array<XYZ,3>& v,const XYZ& m,const boost::array<float,3>&,const C& scan_converter) const
+    {
+      for (uint i=0;i<3;i++)
+        {
+          const boost::array<XYZ,3> p={{v[i],v[(i+1)%3],m}};
+          scan_converter.scan_convert(p,*this);
+        }
+    }
+
+ private:
+
+  std::pair<uint,uint>& _extent;
+};
+
+//! Renders the triangles of a layer L (see TerrainTextureLayer) into the whole of, or bands of rows of, a width by height texture.
+/*! find_extents() does a (parallel) dry run of the scan converter to find the rows each triangle touches.
+  render() can then draw a list of triangles clipped to a range of rows, skipping those not touching them;
+  concurrent calls for disjoint rows never write to the same pixel,
+  and as long as triangles are listed in mesh order the result is the same as rendering the whole mesh serially.
+  band() maintains such a list for successive bands down the texture.
+  The texture is the mesh geometry's own map unless a cube map face of a (spherical) mesh is specified.
+ */
+template <class L> class TextureRenderer
+{
+ public:
+
+  TextureRenderer(const L& layer,uint width,uint height,const CubeMapFace* face=0)
+    :_layer(layer)
+    ,_width(width)
+    ,_height(height)
+    ,_face(face)
+    ,_extent(layer.mesh().triangles())
+    ,_next(0)
+    {}
+
+  //! Find the range of rows each triangle touches, and order the triangles for band().
+  void find_extents()
+    {
+      parallel_for(_layer.mesh().triangles(),boost::bind(&TextureRenderer::find_extents_in,this,_1,_2));
+
+      // Sorting (first row,index) pairs keeps triangles starting on the same row in mesh order.
+      _by_first_row.clear();
+      for (uint i=0;i<_extent.size();i++)
+        if (_extent[i].first<_extent[i].second)
+          _by_first_row.push_back(std::make_pair(_extent[i].first,i));
+      std::sort(_by_first_row.begin(),_by_first_row.end());
+      _active.clear();
+      _next=0;
+    }
+
+  //! All the triangles, in mesh order.
+  const std::vector<uint> all() const
+    {
+      std::vector<uint> triangles(_extent.size());
+      for (uint i=0;i<triangles.size();i++)
+        triangles[i]=i;
+      return triangles;
+    }
+
+  //! Those triangles (in mesh order) touching rows [begin,end).
+  /*! Bands must be requested in order down the texture, each starting where the last ended.
+   */
+  const std::vector<uint>& band(uint begin,uint end)
+    {
+      uint n=0;
+      for (uint j=0;j<_active.size();j++)
+        if (_extent[_active[j]].second>begin)
+          _active[n++]=_active[j];
+      _active.resize(n);
+
+      _added.clear();
+      while (_next<_by_first_row.size() && _by_first_row[_next].first<end)
+        _added.push_back(_by_first_row[_next++].second);
+      std::sort(_added.begin(),_added.end());
+
+      _merged.clear();
+      std::merge(_active.begin(),_active.end(),_added.begin(),_added.end(),std::back_inserter(_merged));
+      _active.swap(_merged);
+      return _active;
+    }
+
+  //! Draw the listed triangles into raster rows [begin,end) of target (a convenient form for parallel_for).
+  void render_rows(const std::vector<uint>& triangles,const typename L::Target& target,uint begin,uint end) const
+    {
+      typename L::Target rows(target);
+      rows.clip(begin,end);
+      render(triangles,rows);
+    }
+
+  //! Draw the listed triangles into target.
+  void render(const std::vector<uint>& triangles,const typename L::Target& target) const
+    {
+      const Geometry& geometry=_layer.mesh().geometry();
+      if (_face)
+        draw_triangles(*_face,triangles,target);
+      else if (const GeometrySpherical*const g=dynamic_cast<const GeometrySpherical*>(&geometry))
+        draw_triangles(*g,triangles,target);
+      else if (const GeometryFlat*const g=dynamic_cast<const GeometryFlat*>(&geometry))
+        draw_triangles(*g,triangles,target);
+      else
+        fatal_internal_error(__FILE__,__LINE__);
+    }
+
+ private:
+
+  //! Body of render, bound to a specific geometry type (or cube map face).
+  template <class G> void draw_triangles(const G& geometry,const std::vector<uint>& triangles,const typename L::Target& target) const
+    {
+      const TriangleMesh& mesh=_layer.mesh();
+      boost::array<typename L::Attribute,3> attributes;
+
+      for (uint j=0;j<triangles.size();j++)
+        {
+          const uint i=triangles[j];
+          if (_extent[i].second<=target.row_begin() || target.row_end()<=_extent[i].first) continue;
+
+          const Triangle& t=mesh.triangle(i);
+          const boost::array<XYZ,3> vertex_positions
+            ={{
+              mesh.vertex(t.vertex(0)).position(),
+              mesh.vertex(t.vertex(1)).position(),
+              mesh.vertex(t.vertex(2)).position()
+            }};
+          _layer.attributes(i,attributes);
+
+          geometry.scan_convert
+            (
+             vertex_positions,
+             ScanConvertHelper<typename L::Attribute,typename L::Target>(target,attributes)
+             );
+        }
+    }
+
+  void find_extents_in(uint begin,uint end)
+    {
+      const Geometry& geometry=_layer.mesh().geometry();
+      if (_face)
+        find_triangle_extents(*_face,begin,end);
+      else if (const GeometrySpherical*const g=dynamic_cast<const GeometrySpherical*>(&geometry))
+        find_triangle_extents(*g,begin,end);
+      else if (const GeometryFlat*const g=dynamic_cast<const GeometryFlat*>(&geometry))
+        find_triangle_extents(*g,begin,end);
+      else
+        fatal_internal_error(__FILE__,__LINE__);
+    }
+
+  //! Body of find_extents_in, bound to a specific geometry type (or cube map face).
+  template <class G> void find_triangle_extents(const G& geometry,uint begin,uint end)
+    {
+      const TriangleMesh& mesh=_layer.mesh();
+      for (uint i=begin;i<end;i++)
+        {
+          const Triangle& t=mesh.triangle(i);
+          const boost::array<XYZ,3> vertex_positions
+            ={{
+              mesh.vertex(t.vertex(0)).position(),
+              mesh.vertex(t.vertex(1)).position(),
+              mesh.vertex(t.vertex(2)).position()
+            }};
+
+          _extent[i]=std::make_pair(_height,0u);
+          geometry.scan_convert(vertex_positions,RowExtentHelper(_width,_height,_extent[i]));
+        }
+    }
+
+  const L& _layer;
+  const uint _width;
+  const uint _height;
+
+  //! Cube map face rendered, if not the geometry's own map.
+  const CubeMapFace*const _face;
+
+  //! Rows [first,second) touched by each triangle (empty if it isn't drawn at all).
+  std::vector<std::pair<uint,uint> > _extent;
+
+  //! (First row,index) of each drawn triangle, in order.
+  std::vector<std::pair<uint,uint> > _by_first_row;
+
+  //! Next entry of _by_first_row to join the active list.
+  uint _next;
+
+  //! Triangles touching the current band, in mesh order.
+  std::vector<uint> _active;
+
+  //! Workspace for band().
+  std::vector<uint> _added;
+  std::vector<uint> _merged;
+};
+
+#endif
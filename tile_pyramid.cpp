@@ -0,0 +1,171 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+#include "precompiled.h"
+
+#include "tile_pyramid.h"
+
+#include "parallel.h"
+#include "texture_renderer.h"
+
+namespace
+{
+  //! Add the normal a normal map pixel encodes to sum, unless the pixel is the flat background.
+  void accumulate_normal(const ByteRGBA& c,XYZ& sum,uint& n)
+  {
+    if (c.r==128 && c.g==128 && c.b==128) return;
+    sum+=XYZ(c.r/127.5f-1.0f,c.g/127.5f-1.0f,c.b/127.5f-1.0f);
+    n++;
+  }
+}
+
+ByteRGBA NormalMean::operator()(const ByteRGBA& a,const ByteRGBA& b,const ByteRGBA& c,const ByteRGBA& d) const
+{
+  XYZ sum(0.0f,0.0f,0.0f);
+  uint n=0;
+  accumulate_normal(a,sum,n);
+  accumulate_normal(b,sum,n);
+  accumulate_normal(c,sum,n);
+  accumulate_normal(d,sum,n);
+  if (n==0 || sum.magnitude2()==0.0f) return ByteRGBA(128,128,128,0);
+  return ByteRGBA(NormalColour()(sum));
+}
+
+template <typename T,class R> TilePyramidWriter<T,R>::TilePyramidWriter(const std::string& directory,uint width,uint height,uint tile_size,const T& pad,const ImageFormat& format)
+  :_height(height)
+  ,_tile_size(tile_size)
+  ,_pad(pad)
+  ,_format(format)
+  ,_filter()
+  ,_rows(0)
+  ,_ok(true)
+{
+  assert(tile_size>=2 && tile_size%2==0);
+
+  std::vector<std::pair<uint,uint> > sizes(1,std::make_pair(width,height));
+  while (sizes.back().second>tile_size)
+    sizes.push_back(std::make_pair((sizes.back().first+1)/2,(sizes.back().second+1)/2));
+
+  // The directories may already exist; any real problem shows up when the tiles can't be written.
+  mkdir(directory.c_str(),0777);
+  for (uint l=0;l<sizes.size();l++)
+    {
+      std::ostringstream level_directory;
+      level_directory << directory << "/level" << sizes.size()-1-l;
+      mkdir(level_directory.str().c_str(),0777);
+      _levels.push_back(boost::shared_ptr<Level>(new Level(level_directory.str(),sizes[l].first,tile_size)));
+    }
+}
+
+template <typename T,class R> TilePyramidWriter<T,R>::~TilePyramidWriter()
+{}
+
+template <typename T,class R> bool TilePyramidWriter<T,R>::write(const Raster<T>& band)
+{
+  Level& finest=*_levels.front();
+  assert(band.width()==finest.strip.width() && _rows+band.height()<=_height);
+  for (uint r=0;r<band.height();)
+    {
+      const uint rows=std::min(band.height()-r,_tile_size-finest.rows);
+      for (uint i=0;i<rows;i++)
+        std::copy(band.row(r+i),band.row(r+i)+band.width(),finest.strip.row(finest.rows+i));
+      finest.rows+=rows;
+      r+=rows;
+      if (finest.rows==_tile_size) flush(0);
+    }
+  _rows+=band.height();
+  return _ok;
+}
+
+template <typename T,class R> bool TilePyramidWriter<T,R>::close()
+{
+  // Flushing a level adds rows to the next, so finest first.
+  for (uint l=0;l<_levels.size();l++)
+    if (_levels[l]->rows) flush(l);
+  return _ok && _rows==_height;
+}
+
+template <typename T,class R> void TilePyramidWriter<T,R>::flush(uint l)
+{
+  Level& level=*_levels[l];
+
+  const uint columns=(level.strip.width()+_tile_size-1)/_tile_size;
+  std::vector<uchar> written(columns,false);
+  parallel_for(columns,boost::bind(&TilePyramidWriter<T,R>::write_tiles,this,boost::cref(level),boost::ref(written),_1,_2));
+  if (std::find(written.begin(),written.end(),false)!=written.end()) _ok=false;
+  level.tile_row++;
+
+  if (l+1<_levels.size())
+    {
+      Level& coarser=*_levels[l+1];
+      // A final odd row pairs with itself.
+      const uint rows=(level.rows+1)/2;
+      assert(coarser.rows+rows<=_tile_size);
+      parallel_for(rows,boost::bind(&TilePyramidWriter<T,R>::downsample,this,boost::cref(level),boost::ref(coarser),coarser.rows,_1,_2));
+      coarser.rows+=rows;
+      level.rows=0;
+      if (coarser.rows==_tile_size) flush(l+1);
+    }
+  else
+    {
+      level.rows=0;
+    }
+}
+
+template <typename T,class R> void TilePyramidWriter<T,R>::write_tiles(const Level& level,std::vector<uchar>& written,uint begin,uint end) const
+{
+  Image<T> tile(_tile_size,_tile_size);
+  for (uint c=begin;c<end;c++)
+    {
+      const uint x=c*_tile_size;
+      const uint w=std::min(_tile_size,level.strip.width()-x);
+      if (w<_tile_size || level.rows<_tile_size) tile.fill(_pad);
+      for (uint r=0;r<level.rows;r++)
+        std::copy(level.strip.row(r)+x,level.strip.row(r)+x+w,tile.row(r));
+
+      std::ostringstream filename;
+      filename << level.directory << "/tx_" << c << "_" << level.tile_row << "." << _format.extension<T>();
+      RasterWriter<T> out(filename.str(),_tile_size,_tile_size,_format);
+      written[c]=(out.write(tile) && out.close());
+    }
+}
+
+template <typename T,class R> void TilePyramidWriter<T,R>::downsample(const Level& level,Level& coarser,uint first,uint begin,uint end) const
+{
+  const uint width=coarser.strip.width();
+  // A final odd column pairs with itself too.
+  const uint last_column=level.strip.width()-1;
+  for (uint r=begin;r<end;r++)
+    {
+      const T*const row0=level.strip.row(2*r);
+      const T*const row1=level.strip.row(std::min(2*r+1,level.rows-1));
+      T*const out=coarser.strip.row(first+r);
+      for (uint x=0;x<width;x++)
+        {
+          const uint x0=2*x;
+          const uint x1=std::min(x0+1,last_column);
+          out[x]=_filter(row0[x0],row0[x1],row1[x0],row1[x1]);
+        }
+    }
+}
+
+template class TilePyramidWriter<uchar>;
+template class TilePyramidWriter<ushort>;
+template class TilePyramidWriter<ByteRGBA>;
+template class TilePyramidWriter<ByteRGBA,NormalMean>;
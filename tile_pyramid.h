@@ -0,0 +1,152 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Interface for class TilePyramidWriter.
+*/
+
+#ifndef _tile_pyramid_h_
+#define _tile_pyramid_h_
+
+#include "image.h"
+
+//! Downsampling filter: the mean (rounded to nearest) of a 2x2 block of pixels.
+template <typename T> class PixelMean
+{
+ public:
+
+  T operator()(const T& a,const T& b,const T& c,const T& d) const
+    {
+      return (static_cast<uint>(a)+b+c+d+2)/4;
+    }
+};
+
+template <> class PixelMean<ByteRGBA>
+{
+ public:
+
+  ByteRGBA operator()(const ByteRGBA& a,const ByteRGBA& b,const ByteRGBA& c,const ByteRGBA& d) const
+    {
+      return ByteRGBA
+        (
+         (static_cast<uint>(a.r)+b.r+c.r+d.r+2)/4,
+         (static_cast<uint>(a.g)+b.g+c.g+d.g+2)/4,
+         (static_cast<uint>(a.b)+b.b+c.b+d.b+2)/4,
+         (static_cast<uint>(a.a)+b.a+c.a+d.a+2)/4
+         );
+    }
+};
+
+//! Downsampling filter for normal maps: the renormalised mean of the normals a 2x2 block of pixels encodes.
+/*! Pixels still holding the flat (128,128,128) background encode no normal, and are left out of the mean.
+ */
+class NormalMean
+{
+ public:
+
+  ByteRGBA operator()(const ByteRGBA& a,const ByteRGBA& b,const ByteRGBA& c,const ByteRGBA& d) const;
+};
+
+//! Writes an image a band of rows at a time (as RasterWriter does) but as a pyramid of fixed-size square tiles.
+/*! The image is written as a quadtree: directory/level<n>/tx_<column>_<row>.<ppm|pgm>,
+  where the finest level has the full resolution and each coarser level halves it (rounding up),
+  down to level0 which is a single row of tiles (one tile for flat terrain, two for planets, as Celestia expects).
+  Tiles on the right and bottom edges are filled out to full size with the pad value.
+  Each level is downsampled (by the filter R, a functor combining 2x2 blocks of pixels) from the one below as its rows arrive,
+  so only a strip one tile high is held for each level.
+  Assumes explicit instantiation.
+ */
+template <typename T,class R=PixelMean<T> > class TilePyramidWriter : public boost::noncopyable
+{
+ public:
+
+  //! Constructor.  Creates the directories for the levels.  The tile size must be even.
+  TilePyramidWriter(const std::string& directory,uint width,uint height,uint tile_size,const T& pad,const ImageFormat& format=ImageFormat());
+
+  //! Destructor.
+  ~TilePyramidWriter();
+
+  //! Append the rows of a band (which must be the full width of the image).
+  bool write(const Raster<T>& band);
+
+  //! Write out the partially filled strips of each level.  Returns false if there were any errors, or not all rows were written.
+  bool close();
+
+  //! Number of levels in the pyramid.
+  uint levels() const
+    {
+      return _levels.size();
+    }
+
+ private:
+
+  //! The strip of rows currently being accumulated for one level of the pyramid.
+  class Level
+  {
+  public:
+
+    Level(const std::string& directory,uint width,uint tile_size)
+      :directory(directory)
+      ,strip(width,tile_size)
+      ,rows(0)
+      ,tile_row(0)
+      {}
+
+    const std::string directory;
+
+    Image<T> strip;
+
+    //! Number of rows of the strip filled so far.
+    uint rows;
+
+    //! Tile row the strip will be written as.
+    uint tile_row;
+  };
+
+  //! Levels, finest first.
+  std::vector<boost::shared_ptr<Level> > _levels;
+
+  const uint _height;
+
+  const uint _tile_size;
+
+  const T _pad;
+
+  //! File format of the tiles.
+  const ImageFormat _format;
+
+  const R _filter;
+
+  //! Number of rows of the full resolution image written so far.
+  uint _rows;
+
+  //! Whether every tile written so far was written successfully.
+  bool _ok;
+
+  //! Write out level l's strip as a row of tiles, and downsample it into the next coarser level (which may in turn fill up).
+  void flush(uint l);
+
+  //! Write out the tiles for columns [begin,end) of a level's strip, noting which succeeded in written.
+  void write_tiles(const Level& level,std::vector<uchar>& written,uint begin,uint end) const;
+
+  //! Downsample a level's strip into the next coarser level's strip, as rows [begin,end) of those starting at row first.
+  void downsample(const Level& level,Level& coarser,uint first,uint begin,uint end) const;
+};
+
+#endif
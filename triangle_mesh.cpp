@@ -21,10 +21,18 @@
 
 #include "triangle_mesh.h"
 
+#include "async_ofstream.h"
+#include "geodesic_grid.h"
+#include "little_endian.h"
+#include "parallel.h"
+#include "subdivision_topology.h"
+#include "text_format.h"
+
 TriangleMesh::TriangleMesh(Progress* progress)
   :_triangle_switch_colour(0)
    ,_emissive(0.0)
    ,_progress(progress)
+   ,_subdivisions(0)
 {}
 
 TriangleMesh::~TriangleMesh()
@@ -102,9 +110,49 @@ void TriangleMesh::compute_vertex_normals()
  */
 void TriangleMesh::subdivide(const XYZ& variation,uint level,uint levels)
 {
-  const uint steps=vertices()+triangles();
+  const SubdivisionTopology topology(vertices(),_triangle,1);
+  _vertex.reserve(topology.vertices());
+  subdivide_vertices(topology.midpoints(0),variation,level,levels);
+  _triangle=topology.triangles();
+  _subdivisions++;
+}
+
+void TriangleMesh::subdivide(uint subdivisions,uint flat_subdivisions,const XYZ& variation)
+{
+  const boost::shared_ptr<const SubdivisionTopology> topology(SubdivisionTopology::shared(vertices(),_triangle,subdivisions));
+  subdivide(*topology,flat_subdivisions,variation);
+}
+
+template <class G> void TriangleMesh::subdivide_vertices(const G& geometry,const std::vector<std::pair<uint,uint> >& midpoints,const XYZ& variation)
+{
+  const uint steps=vertices()+midpoints.size();
   uint step=0;
 
+  for (uint v=0;v<vertices();v++)
+    {
+      step++;
+      progress_step((100*step)/steps);
+
+      _vertex[v]=Vertex(geometry.perturb(_vertex[v].position(),variation));
+    }
+
+  for (uint m=0;m<midpoints.size();m++)
+    {
+      step++;
+      progress_step((100*step)/steps);
+
+      const XYZ& p0=vertex(midpoints[m].first).position();
+      const XYZ& p1=vertex(midpoints[m].second).position();
+      _vertex.push_back(Vertex(geometry.perturb(geometry.midpoint(p0,p1),variation)));
+    }
+}
+
+/*! Existing vertices are perturbed in place and midpoints appended,
+  so with storage reserved up front there is no reallocation and no copy of the old vertices.
+  The geometry is resolved once here rather than per vertex.
+ */
+void TriangleMesh::subdivide_vertices(const std::vector<std::pair<uint,uint> >& midpoints,const XYZ& variation,uint level,uint levels)
+{
   {
     std::ostringstream msg;
     msg
@@ -115,179 +163,363 @@ void TriangleMesh::subdivide(const XYZ& variation,uint level,uint levels)
     progress_start(100,msg.str());
   }
 
-  {
-    // Efficiently move aside current geometry, get ready for fresh.
-    std::vector<Vertex> old_vertex;
-    old_vertex.swap(_vertex);
+  if (const GeometrySpherical*const g=dynamic_cast<const GeometrySpherical*>(&geometry()))
+    subdivide_vertices(GeometryStatic<GeometrySpherical>(*g),midpoints,variation);
+  else if (const GeometryFlat*const g=dynamic_cast<const GeometryFlat*>(&geometry()))
+    subdivide_vertices(GeometryStatic<GeometryFlat>(*g),midpoints,variation);
+  else
+    subdivide_vertices(geometry(),midpoints,variation);
 
-    std::vector<Triangle> old_triangle;
-    old_triangle.swap(_triangle);
+  progress_complete("Subdivision completed");
+}
 
-    // Copy back all vertices and perturb
-    for (uint v=0;v<old_vertex.size();v++)
-      {
-    step++;
-    progress_step((100*step)/steps);
+/*! Produces the same mesh as applying subdivide(variation,level,levels) topology.levels() times would
+  (unperturbed for the first flat_subdivisions levels, then halving the variation each level),
+  but with the new vertices and triangles taken from the topology rather than discovered through an edge map.
+  Vertex storage is reserved once for the final count, and the final triangles are copied in once.
+ */
+void TriangleMesh::subdivide(const SubdivisionTopology& topology,uint flat_subdivisions,const XYZ& variation)
+{
+  assert(vertices()==topology.base_vertices());
 
-    _vertex.push_back(Vertex(geometry().perturb(old_vertex[v].position(),variation)));
-      }
+  _vertex.reserve(topology.vertices());
 
-    // Build a map from edges to new midpoints
-    typedef std::map<TriangleEdge,uint> EdgeMap;
-    EdgeMap edge_map;
+  const uint levels=topology.levels();
+  for (uint level=0;level<levels;level++)
+    {
+      const XYZ level_variation(level<flat_subdivisions ? XYZ(0.0,0.0,0.0) : variation/(1<<level));
+      subdivide_vertices(topology.midpoints(level),level_variation,level,levels);
+    }
+  assert(vertices()==topology.vertices());
 
-    // Create new vertices and new triangles
-    for (uint t=0;t<old_triangle.size();t++)
-      {
-    step++;
-    progress_step((100*step)/steps);
+  _triangle=topology.triangles();
+  _subdivisions+=levels;
+}
+
+namespace
+{
+  //! Navigates the quadtree implicit in the triangle ordering produced by TriangleMesh::subdivide.
+  /*! Node a at level l covers finest-level triangles [a*4^(levels-l),(a+1)*4^(levels-l)).
+    Child c (0-2) of a node contains its corner c, child 3 is the central triangle.
+   */
+  class SubdivisionHierarchy
+  {
+  public:
+
+    SubdivisionHierarchy(const std::vector<Triangle>& triangle,uint levels)
+      :_triangle(triangle)
+      ,_levels(levels)
+    {}
+
+    //! Vertex at corner c of node a at level l.
+    uint corner(uint l,uint a,uint c) const
+    {
+      // Descend into child c until the finest level is reached.
+      const uint n=(1u<<(2*(_levels-l)));
+      return _triangle[a*n+c*((n-1)/3)].vertex(c);
+    }
 
-    // These are the existing vertices
-    const uint i0=old_triangle[t].vertex(0);
-    const uint i1=old_triangle[t].vertex(1);
-    const uint i2=old_triangle[t].vertex(2);
+    //! Vertex at the midpoint of edge e (corner e to corner e+1) of node a at level l<levels.
+    uint midpoint(uint l,uint a,uint e) const
+    {
+      return corner(l+1,4*a+e,(e+1)%3);
+    }
 
-    // These are the edges
-    TriangleEdge e01(i0,i1);
-    TriangleEdge e12(i1,i2);
-    TriangleEdge e20(i2,i0);
+    //! Vertex at the quarter point of edge e of node a at level l<levels-1; q selects the end nearer corner e (0) or e+1 (1).
+    uint quarter(uint l,uint a,uint e,uint q) const
+    {
+      return midpoint(l+1,4*a+(e+q)%3,e);
+    }
 
-    // Find each edge in the map
-    // If any edges don't exist, create their new mid-point and remember it
-    EdgeMap::const_iterator e01it=edge_map.find(e01);
-    EdgeMap::const_iterator e12it=edge_map.find(e12);
-    EdgeMap::const_iterator e20it=edge_map.find(e20);
+  private:
 
-    const bool e01needed=(e01it==edge_map.end());
-    const bool e12needed=(e12it==edge_map.end());
-    const bool e20needed=(e20it==edge_map.end());
+    const std::vector<Triangle>& _triangle;
 
-    if (e01needed)
-      {
-        e01it=edge_map.insert(EdgeMap::value_type(e01,_vertex.size())).first;
-        _vertex.push_back(Vertex(geometry().perturb(geometry().midpoint(vertex(i0).position(),vertex(i1).position()),variation)));
-      }
+    const uint _levels;
+  };
+}
 
-    if (e12needed)
-      {
-        e12it=edge_map.insert(EdgeMap::value_type(e12,_vertex.size())).first;
-        _vertex.push_back(Vertex(geometry().perturb(geometry().midpoint(vertex(i1).position(),vertex(i2).position()),variation)));
-      }
+void TriangleMesh::coarsen_triangles(const std::vector<bool>& flagged,float max_sag,std::vector<Triangle>& kept,std::vector<Triangle>& merged) const
+{
+  assert(flagged.size()==triangles());
 
-    if (e20needed)
-      {
-        e20it=edge_map.insert(EdgeMap::value_type(e20,_vertex.size())).first;
-        _vertex.push_back(Vertex(geometry().perturb(geometry().midpoint(vertex(i2).position(),vertex(i0).position()),variation)));
-      }
+  const uint levels=_subdivisions;
+  const SubdivisionHierarchy hierarchy(_triangle,levels);
 
-    // Create the subdivided triangles
+  // Which nodes at each level have all their finest-level triangles flagged.
+  std::vector<std::vector<bool> > all_flagged(levels+1);
+  all_flagged[levels]=flagged;
+  for (uint l=levels;l>0;l--)
+    {
+      const std::vector<bool>& finer=all_flagged[l];
+      std::vector<bool>& coarser=all_flagged[l-1];
+      coarser.resize(finer.size()/4);
+      for (uint a=0;a<coarser.size();a++)
+        coarser[a]=(finer[4*a] && finer[4*a+1] && finer[4*a+2] && finer[4*a+3]);
+    }
 
-    _triangle.push_back(Triangle(i0,(*e01it).second,(*e20it).second));
-    _triangle.push_back(Triangle((*e01it).second,i1,(*e12it).second));
-    _triangle.push_back(Triangle((*e20it).second,(*e12it).second,i2));
-    _triangle.push_back(Triangle((*e01it).second,(*e12it).second,(*e20it).second));
+  // Find the coarsest acceptable node covering each region, as (level,node) pairs.
+  typedef std::pair<uint,uint> Node;
+  std::vector<Node> leaves;
+  {
+    std::vector<Node> pending;
+    for (uint a=all_flagged[0].size();a>0;a--)
+      pending.push_back(Node(0,a-1));
+
+    while (!pending.empty())
+      {
+        const Node node(pending.back());
+        pending.pop_back();
+
+        const uint l=node.first;
+        const uint a=node.second;
+
+        bool leaf=(l==levels);
+        if (!leaf && all_flagged[l][a])
+          {
+            const XYZ& p0=vertex(hierarchy.corner(l,a,0)).position();
+            const XYZ& p1=vertex(hierarchy.corner(l,a,1)).position();
+            const XYZ& p2=vertex(hierarchy.corner(l,a,2)).position();
+            const float corner_height=(geometry().height(p0)+geometry().height(p1)+geometry().height(p2))/3.0f;
+            leaf=(corner_height-geometry().height((p0+p1+p2)/3.0f)<=max_sag);
+          }
+
+        if (leaf)
+          leaves.push_back(node);
+        else
+          for (uint c=4;c>0;c--)
+            pending.push_back(Node(l+1,4*a+c-1));
       }
   }
 
-  progress_complete("Subdivision completed");
+  // Restore balance: a node may not have a neighbour more than one level finer.
+  // Any vertex used by a neighbour strictly inside one of our edges must be our edge's midpoint.
+  std::vector<bool> used(vertices());
+  for (bool balanced=false;!balanced;)
+    {
+      std::fill(used.begin(),used.end(),false);
+      for (uint i=0;i<leaves.size();i++)
+        for (uint c=0;c<3;c++)
+          used[hierarchy.corner(leaves[i].first,leaves[i].second,c)]=true;
+
+      balanced=true;
+      std::vector<Node> balanced_leaves;
+      balanced_leaves.reserve(leaves.size());
+      for (uint i=0;i<leaves.size();i++)
+        {
+          const uint l=leaves[i].first;
+          const uint a=leaves[i].second;
+
+          bool split=false;
+          if (l+2<=levels)
+            for (uint e=0;e<3 && !split;e++)
+              split=(used[hierarchy.quarter(l,a,e,0)] || used[hierarchy.quarter(l,a,e,1)]);
+
+          if (split)
+            {
+              balanced=false;
+              for (uint c=0;c<4;c++)
+                balanced_leaves.push_back(Node(l+1,4*a+c));
+            }
+          else
+            balanced_leaves.push_back(leaves[i]);
+        }
+      leaves.swap(balanced_leaves);
+    }
+
+  // Emit triangles, splitting coarse nodes along any edge a finer neighbour has a vertex on.
+  for (uint i=0;i<leaves.size();i++)
+    {
+      const uint l=leaves[i].first;
+      const uint a=leaves[i].second;
+
+      if (l==levels)
+        {
+          (flagged[a] ? merged : kept).push_back(triangle(a));
+          continue;
+        }
+
+      boost::array<uint,3> c;
+      boost::array<uint,3> m;
+      boost::array<bool,3> s;
+      uint splits=0;
+      for (uint e=0;e<3;e++)
+        {
+          c[e]=hierarchy.corner(l,a,e);
+          m[e]=hierarchy.midpoint(l,a,e);
+          s[e]=used[m[e]];
+          if (s[e]) splits++;
+        }
+
+      if (splits==0)
+        {
+          merged.push_back(Triangle(c[0],c[1],c[2]));
+        }
+      else if (splits==3)
+        {
+          merged.push_back(Triangle(c[0],m[0],m[2]));
+          merged.push_back(Triangle(m[0],c[1],m[1]));
+          merged.push_back(Triangle(m[2],m[1],c[2]));
+          merged.push_back(Triangle(m[0],m[1],m[2]));
+        }
+      else
+        {
+          // Rotate so that the single split edge is edge 0, or the single unsplit edge is edge 2.
+          uint r=0;
+          while (s[splits==1 ? r : (r+2)%3]!=(splits==1)) r++;
+          const uint c0=c[r];
+          const uint c1=c[(r+1)%3];
+          const uint c2=c[(r+2)%3];
+          const uint m0=m[r];
+          if (splits==1)
+            {
+              merged.push_back(Triangle(c0,m0,c2));
+              merged.push_back(Triangle(m0,c1,c2));
+            }
+          else
+            {
+              const uint m1=m[(r+1)%3];
+              merged.push_back(Triangle(m0,c1,m1));
+              merged.push_back(Triangle(c0,m0,m1));
+              merged.push_back(Triangle(c0,m1,c2));
+            }
+        }
+    }
 }
 
-void TriangleMesh::subdivide(uint subdivisions,uint flat_subdivisions,const XYZ& variation)
+void TriangleMesh::remove_unreferenced_vertices()
 {
-  for (uint s=0;s<subdivisions;s++)
+  const uint unreferenced=static_cast<uint>(-1);
+  std::vector<uint> remap(vertices(),unreferenced);
+
+  for (uint t=0;t<triangles();t++)
+    for (uint i=0;i<3;i++)
+      remap[triangle(t).vertex(i)]=0;
+
+  uint n=0;
+  for (uint v=0;v<vertices();v++)
     {
-      if (s<flat_subdivisions)
-    subdivide(XYZ(0.0,0.0,0.0),s,subdivisions);
-      else
-    subdivide(variation/(1<<s),s,subdivisions);
+      if (remap[v]!=unreferenced)
+        {
+          remap[v]=n;
+          if (n!=v) _vertex[n]=_vertex[v];
+          n++;
+        }
+    }
+  _vertex.erase(_vertex.begin()+n,_vertex.end());
+
+  for (uint t=0;t<triangles();t++)
+    {
+      const Triangle& old_triangle=triangle(t);
+      triangle(t)=Triangle(remap[old_triangle.vertex(0)],remap[old_triangle.vertex(1)],remap[old_triangle.vertex(2)]);
     }
 }
 
-void TriangleMesh::write_povray(std::ofstream& out,bool exclude_alternate_colour,bool double_illuminate,bool no_shadow) const
+namespace
 {
-  // \todo: No need to dump all vertices when not outputing all triangles.
+  //! Quantise a colour component to the given number of bits, keeping 0 and 255 (so opaque, clear and emissive colours stay so).
+  uchar quantise(uchar v,uint bits)
+  {
+    const uint levels=(1u<<bits)-1;
+    return ((v>>(8-bits))*255+levels/2)/levels;
+  }
+
+  //! Colours as they go in a palette of the given bits per channel, packed into a sortable key.
+  uint palette_key(const ByteRGBA& c,uint bits)
+  {
+    return
+      (static_cast<uint>(quantise(c.r,bits))<<24)
+      |(static_cast<uint>(quantise(c.g,bits))<<16)
+      |(static_cast<uint>(quantise(c.b,bits))<<8)
+      |static_cast<uint>(quantise(c.a,bits));
+  }
+
+  //! Inverse of palette_key.
+  ByteRGBA palette_colour(uint key)
+  {
+    return ByteRGBA(key>>24,(key>>16)&0xff,(key>>8)&0xff,key&0xff);
+  }
+}
+
+TriangleMesh::ExportedVertices::ExportedVertices(const TriangleMesh& mesh,uint begin,uint end)
+  :_vertices(0)
+{
+  std::vector<uchar> referenced(mesh.vertices(),0);
+  for (uint t=begin;t<end;t++)
+    for (uint i=0;i<3;i++)
+      referenced[mesh.triangle(t).vertex(i)]=1;
+
+  _vertices=std::count(referenced.begin(),referenced.end(),1);
+  if (_vertices==mesh.vertices()) return;
+
+  _mesh_vertex.reserve(_vertices);
+  _exported_vertex.resize(mesh.vertices(),0);
+  for (uint v=0;v<mesh.vertices();v++)
+    if (referenced[v])
+      {
+        _exported_vertex[v]=_mesh_vertex.size();
+        _mesh_vertex.push_back(v);
+      }
+}
 
+/*! Each section is formatted a batch of chunks at a time, the chunks in parallel, and written in order with one write per chunk.
+  With a palette, texture_list is the distinct quantised colours (sorted), and faces index those rather than a texture per vertex and colour.
+ */
+void TriangleMesh::write_povray(std::ostream& out,bool exclude_alternate_colour,bool double_illuminate,bool no_shadow,uint palette_bits) const
+{
   const uint triangles_to_output=(exclude_alternate_colour ? triangles_of_colour0() : triangles());
+  const ExportedVertices exported(*this,0,triangles_to_output);
+  const uint vertices_to_output=exported.vertices();
+  const uint vertex_colours=vertices_to_output+(exclude_alternate_colour ? 0 : vertices_to_output);
+
+  progress_start(100,"Writing mesh to POV-Ray file");
+
+  // Texture for each vertex colour (vertex colour 0s then any 1s), as an index into the palette if there is one.
+  std::vector<uint> texture_index;
+  std::vector<ByteRGBA> palette;
+  if (palette_bits)
+    {
+      assert(palette_bits<=8);
+      texture_index.resize(vertex_colours);
+      for (uint i=0;i<vertex_colours;i++)
+        texture_index[i]=palette_key(vertex(exported.mesh_vertex(i%vertices_to_output)).colour(i/vertices_to_output),palette_bits);
+
+      std::vector<uint> keys(texture_index);
+      std::sort(keys.begin(),keys.end());
+      keys.erase(std::unique(keys.begin(),keys.end()),keys.end());
+      for (uint i=0;i<vertex_colours;i++)
+        texture_index[i]=std::lower_bound(keys.begin(),keys.end(),texture_index[i])-keys.begin();
+      std::transform(keys.begin(),keys.end(),std::back_inserter(palette),palette_colour);
+    }
+  const uint textures=(palette_bits ? palette.size() : vertex_colours);
 
   // The number of steps is:
-  //   vertices() co-ordinates
-  // + vertices()+(exclude_alternate_colour ? 0 : vertices()) textures
+  //   vertices_to_output co-ordinates
+  // + textures textures
   // + triangles_to_output triangles
 
-  const uint steps=vertices()+vertices()+(exclude_alternate_colour ? 0 : vertices())+triangles_to_output;
-  uint step=0;
-
-  progress_start(100,"Writing mesh to POV-Ray file");
+  const uint steps=vertices_to_output+textures+triangles_to_output;
 
   // Use POV's mesh2 object
 
   out << "mesh2 {\n";
 
-  // Output all the vertex co-ordinates
-  out << "vertex_vectors {" << vertices() << ",\n";
-
-  for (uint v=0;v<vertices();v++)
-    {
-      step++;
-      progress_step((100*step)/steps);
-
-      if (v!=0)
-    out << ",";
-      out << vertex(v).position().format_pov() << "\n";
-    }
+  // Output the co-ordinates of the vertices used
+  out << "vertex_vectors {" << vertices_to_output << ",\n";
+  write_formatted(out,vertices_to_output,boost::bind(&TriangleMesh::format_povray_vertices,this,boost::cref(exported),_1,_2,_3),_progress,0,steps);
   out << "}\n";
 
   // Output the vertex colours, and handle emission
   // If exclude_alternate_colour is true, don't output the alternate colours
-  out << "texture_list {" << vertices()+(exclude_alternate_colour ? 0 : vertices()) << "\n";
-
-  for (uint c=0;c<(exclude_alternate_colour ? 1 : 2);c++)
-    for (uint v=0;v<vertices();v++)
-      {
-    step++;
-    progress_step((100*step)/steps);
-
-    out << "texture{pigment{";
-    const FloatRGBA colour(vertex(v).colour(c));
-    if (colour.a==1.0f) out << "rgb " << colour.format_pov_rgb();
-    else out << "rgbf " << colour.format_pov_rgbf();
-    out << "}";
-
-    if (emissive()!=0.0f && vertex(v).colour(c).a==0)
-      {
-        out << " finish{ambient " << emissive() << " diffuse " << 1.0f-emissive() << "}";
-      }
-    out << "}\n";
-      }
-
+  out << "texture_list {" << textures << "\n";
+  if (palette_bits)
+    write_formatted(out,textures,boost::bind(&TriangleMesh::format_povray_palette,this,boost::cref(palette),_1,_2,_3),_progress,vertices_to_output,steps);
+  else
+    write_formatted(out,textures,boost::bind(&TriangleMesh::format_povray_textures,this,boost::cref(exported),_1,_2,_3),_progress,vertices_to_output,steps);
   out << "}\n";
 
   out << "face_indices {" << triangles_to_output << ",\n";
-  bool skip_initial_comma=true;
-  for (uint t=0;t<triangles_to_output;t++)
-    {
-      step++;
-      progress_step((100*step)/steps);
-
-      if (skip_initial_comma)
-    skip_initial_comma=false;
-      else
-    out << ",";
-
-      out
-    << "<"
-    << triangle(t).vertex(0)
-    << ","
-    << triangle(t).vertex(1)
-    << ","
-    << triangle(t).vertex(2)
-    << ">";
-
-      out << "," << triangle(t).vertex(0)+(t<triangles_of_colour0() ? 0 : vertices());
-      out << "," << triangle(t).vertex(1)+(t<triangles_of_colour0() ? 0 : vertices());
-      out << "," << triangle(t).vertex(2)+(t<triangles_of_colour0() ? 0 : vertices());
-      out << "\n";
-    }
+  write_formatted(out,triangles_to_output,boost::bind(&TriangleMesh::format_povray_faces,this,boost::cref(exported),(palette_bits ? &texture_index : 0),_1,_2,_3),_progress,vertices_to_output+textures,steps);
   out << "}\n";
   if (double_illuminate) out << "double_illuminate\n";
   if (no_shadow) out << "no_shadow\n";
@@ -296,68 +528,362 @@ void TriangleMesh::write_povray(std::ofstream& out,bool exclude_alternate_colour
   progress_complete("Wrote mesh to POV-Ray file");
 }
 
-/*! If faux_alpha is null, output per-vertex alpha.
-  If a colour is specified, use the vertex alpha to blend with it.
- */
-void TriangleMesh::write_blender(std::ofstream& out,const std::string& mesh_name,const FloatRGBA* faux_alpha) const
+void TriangleMesh::format_povray_vertices(const ExportedVertices& exported,std::string& s,uint begin,uint end) const
+{
+  for (uint v=begin;v<end;v++)
+    {
+      if (v!=0) s+=',';
+      vertex(exported.mesh_vertex(v)).position().append_pov(s);
+      s+='\n';
+    }
+}
+
+void TriangleMesh::format_povray_texture(std::string& s,const ByteRGBA& c) const
+{
+  s+="texture{pigment{";
+  const FloatRGBA colour(c);
+  if (colour.a==1.0f)
+    {
+      s+="rgb ";
+      colour.append_pov_rgb(s);
+    }
+  else
+    {
+      s+="rgbf ";
+      colour.append_pov_rgbf(s);
+    }
+  s+='}';
+
+  if (emissive()!=0.0f && c.a==0)
+    {
+      s+=" finish{ambient ";
+      append_number(s,emissive());
+      s+=" diffuse ";
+      append_number(s,1.0f-emissive());
+      s+='}';
+    }
+  s+="}\n";
+}
+
+void TriangleMesh::format_povray_textures(const ExportedVertices& exported,std::string& s,uint begin,uint end) const
+{
+  for (uint i=begin;i<end;i++)
+    format_povray_texture(s,vertex(exported.mesh_vertex(i%exported.vertices())).colour(i/exported.vertices()));
+}
+
+void TriangleMesh::format_povray_palette(const std::vector<ByteRGBA>& palette,std::string& s,uint begin,uint end) const
+{
+  for (uint i=begin;i<end;i++)
+    format_povray_texture(s,palette[i]);
+}
+
+void TriangleMesh::format_povray_faces(const ExportedVertices& exported,const std::vector<uint>* texture_index,std::string& s,uint begin,uint end) const
+{
+  for (uint t=begin;t<end;t++)
+    {
+      if (t!=0) s+=',';
+
+      const Triangle& tri=triangle(t);
+      const uint v[3]={exported.exported_vertex(tri.vertex(0)),exported.exported_vertex(tri.vertex(1)),exported.exported_vertex(tri.vertex(2))};
+      s+='<';
+      append_number(s,v[0]);
+      s+=',';
+      append_number(s,v[1]);
+      s+=',';
+      append_number(s,v[2]);
+      s+='>';
+
+      const uint offset=(t<triangles_of_colour0() ? 0 : exported.vertices());
+      for (uint i=0;i<3;i++)
+        {
+          s+=',';
+          const uint vertex_colour=v[i]+offset;
+          append_number(s,(texture_index ? (*texture_index)[vertex_colour] : vertex_colour));
+        }
+      s+='\n';
+    }
+}
+
+namespace
+{
+  //! Vertex normal scaled to unit length (mesh normals are averages, so generally a little short).
+  const XYZ unit_normal(const Vertex& v)
   {
-    std::auto_ptr<ByteRGBA> byte_faux_alpha;
-    if (faux_alpha) byte_faux_alpha=std::auto_ptr<ByteRGBA>(new ByteRGBA(*faux_alpha));
+    const float m=v.normal().magnitude();
+    return (m>0.0f ? v.normal()/m : XYZ(0.0f,0.0f,1.0f));
+  }
+}
 
-    const uint steps=vertices()+triangles();
-    uint step=0;
+/*! PLY and OBJ have just one colour per vertex, so vertices used by both colours' triangles (the coast) are written twice:
+  the vertices of colour 0 triangles with their colour 0, then those of colour 1 triangles with their colour 1.
+ */
+void TriangleMesh::write_ply(std::ostream& out,const std::string& mesh_name) const
+{
+  const ExportedVertices exported0(*this,0,triangles_of_colour0());
+  const ExportedVertices exported1(*this,triangles_of_colour0(),triangles());
+  const uint vertices_to_output=exported0.vertices()+exported1.vertices();
+  const uint steps=vertices_to_output+triangles();
+
+  progress_start(100,"Writing mesh "+mesh_name+" to PLY file");
+
+  out
+    << "ply\n"
+    << "format binary_little_endian 1.0\n"
+    << "comment Fracplanet " << mesh_name << "\n"
+    << "element vertex " << vertices_to_output << "\n"
+    << "property float x\n"
+    << "property float y\n"
+    << "property float z\n"
+    << "property float nx\n"
+    << "property float ny\n"
+    << "property float nz\n"
+    << "property uchar red\n"
+    << "property uchar green\n"
+    << "property uchar blue\n"
+    << "property uchar alpha\n"
+    << "element face " << triangles() << "\n"
+    << "property list uchar uint vertex_indices\n"
+    << "end_header\n";
+
+  write_formatted(out,exported0.vertices(),boost::bind(&TriangleMesh::format_ply_vertices,this,boost::cref(exported0),0,_1,_2,_3),_progress,0,steps);
+  write_formatted(out,exported1.vertices(),boost::bind(&TriangleMesh::format_ply_vertices,this,boost::cref(exported1),1,_1,_2,_3),_progress,exported0.vertices(),steps);
+  write_formatted(out,triangles_of_colour0(),boost::bind(&TriangleMesh::format_ply_faces,this,boost::cref(exported0),0,0,_1,_2,_3),_progress,vertices_to_output,steps);
+  write_formatted(out,triangles_of_colour1(),boost::bind(&TriangleMesh::format_ply_faces,this,boost::cref(exported1),triangles_of_colour0(),exported0.vertices(),_1,_2,_3),_progress,vertices_to_output+triangles_of_colour0(),steps);
+
+  progress_complete("Wrote mesh "+mesh_name+" to PLY file");
+}
 
+void TriangleMesh::format_ply_vertices(const ExportedVertices& exported,uint c,std::string& s,uint begin,uint end) const
+{
+  for (uint i=begin;i<end;i++)
     {
-      std::ostringstream msg;
-      msg << "Writing mesh " << mesh_name << " to Blender script file";
-      progress_start(100,msg.str());
+      const Vertex& v=vertex(exported.mesh_vertex(i));
+      const XYZ n(unit_normal(v));
+      append_little_endian(s,v.position().x);
+      append_little_endian(s,v.position().y);
+      append_little_endian(s,v.position().z);
+      append_little_endian(s,n.x);
+      append_little_endian(s,n.y);
+      append_little_endian(s,n.z);
+      const ByteRGBA& colour=v.colour(c);
+      s+=static_cast<char>(colour.r);
+      s+=static_cast<char>(colour.g);
+      s+=static_cast<char>(colour.b);
+      s+=static_cast<char>(colour.a);
     }
+}
 
-    out <<
-        "mat0 = bpy.data.materials.new(\"fracplanet0\")\n"
-        "mat0.diffuse_color = (0.0, 1.0, 0.0)\n"
-        "mat0.use_vertex_color_paint = True\n"
-        "bpy.ops.object.material_slot_add()\n"
-        "the_mesh_obj.material_slots[-1].material = mat0\n"
-        "mat1 = bpy.data.materials.new(\"fracplanet1\")\n"
-        "mat1.diffuse_color = (0.0, 0.0, 1.0)\n"
-        "mat1.use_vertex_color_paint = True\n"
-        "bpy.ops.object.material_slot_add()\n"
-        "the_mesh_obj.material_slots[-1].material = mat1\n";
+void TriangleMesh::format_ply_faces(const ExportedVertices& exported,uint first,uint base,std::string& s,uint begin,uint end) const
+{
+  for (uint t=begin;t<end;t++)
+    {
+      const Triangle& tri=triangle(first+t);
+      s+=static_cast<char>(3);
+      for (uint i=0;i<3;i++)
+        append_little_endian(s,base+exported.exported_vertex(tri.vertex(i)));
+    }
+}
 
-    for (uint v=0;v<vertices();v++)
-      {
-        step++;
-        progress_step((100*step)/steps);
-        out << "v(" << vertex(v).position().format_blender() << ")\n";
-      }
+/*! Vertex colours follow the vertex co-ordinates on the v lines (as RGB from 0 to 1; alpha is lost),
+  an extension most OBJ readers accept (or ignore).
+  Vertices are duplicated as for write_ply, with a normal (vn) for each.
+ */
+void TriangleMesh::write_obj(std::ostream& out,const std::string& mesh_name) const
+{
+  const ExportedVertices exported0(*this,0,triangles_of_colour0());
+  const ExportedVertices exported1(*this,triangles_of_colour0(),triangles());
+  const uint vertices_to_output=exported0.vertices()+exported1.vertices();
+  const uint steps=2*vertices_to_output+triangles();
+
+  progress_start(100,"Writing mesh "+mesh_name+" to OBJ file");
+
+  out << "# Fracplanet\n" << "o " << mesh_name << "\n";
+  write_formatted(out,exported0.vertices(),boost::bind(&TriangleMesh::format_obj_vertices,this,boost::cref(exported0),0,_1,_2,_3),_progress,0,steps);
+  write_formatted(out,exported1.vertices(),boost::bind(&TriangleMesh::format_obj_vertices,this,boost::cref(exported1),1,_1,_2,_3),_progress,exported0.vertices(),steps);
+  write_formatted(out,exported0.vertices(),boost::bind(&TriangleMesh::format_obj_normals,this,boost::cref(exported0),_1,_2,_3),_progress,vertices_to_output,steps);
+  write_formatted(out,exported1.vertices(),boost::bind(&TriangleMesh::format_obj_normals,this,boost::cref(exported1),_1,_2,_3),_progress,vertices_to_output+exported0.vertices(),steps);
+  write_formatted(out,triangles_of_colour0(),boost::bind(&TriangleMesh::format_obj_faces,this,boost::cref(exported0),0,0,_1,_2,_3),_progress,2*vertices_to_output,steps);
+  write_formatted(out,triangles_of_colour1(),boost::bind(&TriangleMesh::format_obj_faces,this,boost::cref(exported1),triangles_of_colour0(),exported0.vertices(),_1,_2,_3),_progress,2*vertices_to_output+triangles_of_colour0(),steps);
+
+  progress_complete("Wrote mesh "+mesh_name+" to OBJ file");
+}
 
-    out << "\n";
+void TriangleMesh::format_obj_vertices(const ExportedVertices& exported,uint c,std::string& s,uint begin,uint end) const
+{
+  for (uint i=begin;i<end;i++)
+    {
+      const Vertex& v=vertex(exported.mesh_vertex(i));
+      s+="v ";
+      append_number(s,v.position().x);
+      s+=' ';
+      append_number(s,v.position().y);
+      s+=' ';
+      append_number(s,v.position().z);
+      const FloatRGBA colour(v.colour(c));
+      s+=' ';
+      append_number(s,colour.r);
+      s+=' ';
+      append_number(s,colour.g);
+      s+=' ';
+      append_number(s,colour.b);
+      s+='\n';
+    }
+}
 
-    for (uint t=0;t<triangles();t++)
+void TriangleMesh::format_obj_normals(const ExportedVertices& exported,std::string& s,uint begin,uint end) const
+{
+  for (uint i=begin;i<end;i++)
+    {
+      const XYZ n(unit_normal(vertex(exported.mesh_vertex(i))));
+      s+="vn ";
+      append_number(s,n.x);
+      s+=' ';
+      append_number(s,n.y);
+      s+=' ';
+      append_number(s,n.z);
+      s+='\n';
+    }
+}
+
+void TriangleMesh::format_obj_faces(const ExportedVertices& exported,uint first,uint base,std::string& s,uint begin,uint end) const
+{
+  for (uint t=begin;t<end;t++)
+    {
+      const Triangle& tri=triangle(first+t);
+      s+='f';
+      for (uint i=0;i<3;i++)
+        {
+          // OBJ indices count from 1
+          const uint v=base+exported.exported_vertex(tri.vertex(i))+1;
+          s+=' ';
+          append_number(s,v);
+          s+="//";
+          append_number(s,v);
+        }
+      s+='\n';
+    }
+}
+
+namespace
+{
+  //! Quote a string as a Python string literal.
+  std::string python_string(const std::string& s)
+  {
+    std::string q("\"");
+    for (std::string::const_iterator it=s.begin();it!=s.end();it++)
       {
-        step++;
-        progress_step((100*step)/steps);
-        const uint v0=triangle(t).vertex(0);
-        const uint v1=triangle(t).vertex(1);
-        const uint v2=triangle(t).vertex(2);
-        const uint c=(t<triangles_of_colour0() ? 0 : 1);
-        out
-      << "f("
-      << c << ", "
-      << v0 << ", "
-      << v1 << ", "
-      << v2 << ", "
-      << "(" << blender_alpha_workround(byte_faux_alpha.get(),vertex(v0).colour(c)).format_comma() << "), "
-      << "(" << blender_alpha_workround(byte_faux_alpha.get(),vertex(v1).colour(c)).format_comma() << "), "
-      << "(" << blender_alpha_workround(byte_faux_alpha.get(),vertex(v2).colour(c)).format_comma() << ")"
-      << ")\n";
+        if (*it=='\\' || *it=='"') q+='\\';
+        q+=*it;
       }
+    return q+"\"";
+  }
+
+  //! numpy byte order character for this machine's (native) binary data.
+  const char* numpy_byte_order()
+  {
+    const uint one=1;
+    return (*reinterpret_cast<const uchar*>(&one) ? "<" : ">");
+  }
+}
 
+/*! The data file holds, in native byte order, three arrays with no headers or padding:
+  float x,y,z for each written vertex,
+  uint (32 bit) vertex indices, three per triangle,
+  and uchar r,g,b,a for each triangle corner (the colour of the triangle's material, with any faux alpha applied).
+  The script just appends a call to the load function (defined by the script preamble) giving the array sizes,
+  so Blender can build the mesh with a few bulk foreach_set calls rather than a call per vertex and face.
+  If faux_alpha is null, output per-vertex alpha.
+  If a colour is specified, use the vertex alpha to blend with it.
+ */
+void TriangleMesh::write_blender(std::ostream& out,const std::string& data_filename,const std::string& mesh_name,const FloatRGBA* faux_alpha) const
+{
+  std::auto_ptr<ByteRGBA> byte_faux_alpha;
+  if (faux_alpha) byte_faux_alpha=std::auto_ptr<ByteRGBA>(new ByteRGBA(*faux_alpha));
+
+  const ExportedVertices exported(*this,0,triangles());
+
+  {
     std::ostringstream msg;
-    msg << "Wrote mesh " << mesh_name << " to Blender script file";
-    progress_complete(msg.str());
-  } /*TriangleMesh::write_blender*/
+    msg << "Writing mesh " << mesh_name << " to Blender data file";
+    progress_start(100,msg.str());
+  }
+
+  AsyncOfstream data(data_filename,12ULL*exported.vertices()+24ULL*triangles());
+
+  // The number of steps is exported.vertices() co-ordinates + triangles() indices + triangles() colours,
+  // reported a chunk at a time.
+  const uint chunk=65536;
+  const unsigned long long steps=exported.vertices()+2ULL*triangles();
+  unsigned long long step=0;
+
+  std::vector<float> position;
+  for (uint begin=0;begin<exported.vertices();begin+=chunk)
+    {
+      const uint end=std::min(exported.vertices(),begin+chunk);
+      position.clear();
+      for (uint v=begin;v<end;v++)
+        {
+          const XYZ& p=vertex(exported.mesh_vertex(v)).position();
+          position.push_back(p.x);
+          position.push_back(p.y);
+          position.push_back(p.z);
+        }
+      data.write(reinterpret_cast<const char*>(&position[0]),position.size()*sizeof(float));
+      step+=end-begin;
+      progress_step((100*step)/steps);
+    }
+
+  std::vector<uint> index;
+  for (uint begin=0;begin<triangles();begin+=chunk)
+    {
+      const uint end=std::min(triangles(),begin+chunk);
+      index.clear();
+      for (uint t=begin;t<end;t++)
+        for (uint i=0;i<3;i++)
+          index.push_back(exported.exported_vertex(triangle(t).vertex(i)));
+      data.write(reinterpret_cast<const char*>(&index[0]),index.size()*sizeof(uint));
+      step+=end-begin;
+      progress_step((100*step)/steps);
+    }
+
+  std::vector<uchar> colour;
+  for (uint begin=0;begin<triangles();begin+=chunk)
+    {
+      const uint end=std::min(triangles(),begin+chunk);
+      colour.clear();
+      for (uint t=begin;t<end;t++)
+        {
+          const uint c=(t<triangles_of_colour0() ? 0 : 1);
+          for (uint i=0;i<3;i++)
+            {
+              const ByteRGBA corner=blender_alpha_workround(byte_faux_alpha.get(),vertex(triangle(t).vertex(i)).colour(c));
+              colour.push_back(corner.r);
+              colour.push_back(corner.g);
+              colour.push_back(corner.b);
+              colour.push_back(corner.a);
+            }
+        }
+      data.write(reinterpret_cast<const char*>(&colour[0]),colour.size());
+      step+=end-begin;
+      progress_step((100*step)/steps);
+    }
+
+  data.close();
+  if (!data) out.setstate(std::ios::failbit);
+
+  out
+    << "load("
+    << python_string(mesh_name) << ", "
+    << python_string(data_filename) << ", "
+    << exported.vertices() << ", "
+    << triangles() << ", "
+    << triangles_of_colour0() << ", "
+    << "\"" << numpy_byte_order() << "\")\n";
+
+  std::ostringstream msg;
+  msg << "Wrote mesh " << mesh_name << " to Blender data file";
+  progress_complete(msg.str());
+}
 
 ByteRGBA TriangleMesh::blender_alpha_workround(const ByteRGBA* f,const ByteRGBA& c)
 {
@@ -477,7 +1003,59 @@ TriangleMeshIcosahedron::TriangleMeshIcosahedron(float radius,uint seed,Progress
 TriangleMeshSubdividedIcosahedron::TriangleMeshSubdividedIcosahedron(float radius,uint subdivisions,uint flat_subdivisions,uint seed,const XYZ& variation,Progress* progress)
   :TriangleMesh(progress)
   ,TriangleMeshIcosahedron(radius,seed,progress)
+  ,_topology(SubdivisionTopology::shared(vertices(),_triangle,subdivisions))
+{
+  subdivide(*_topology,flat_subdivisions,variation);
+}
+
+TriangleMeshSubdividedIcosahedron::~TriangleMeshSubdividedIcosahedron()
+{}
+
+/*! Vertices are renumbered once terrain simplifies its oceans, and then the generic method is used.
+ */
+void TriangleMeshSubdividedIcosahedron::compute_vertex_normals()
 {
-  subdivide(subdivisions,flat_subdivisions,variation);
+  if (vertices()!=_topology->vertices())
+    {
+      TriangleMesh::compute_vertex_normals();
+      return;
+    }
+
+  progress_start(100,"Compute normals");
+
+  const GeodesicGrid grid(_topology->base_triangles(),_topology->levels());
+  std::vector<uint> mesh_vertex;
+  grid.mesh_vertices(*_topology,mesh_vertex);
+
+  parallel_for
+    (
+     grid.vertices(),
+     boost::bind(&TriangleMeshSubdividedIcosahedron::compute_vertex_normals_on_grid,this,boost::cref(grid),boost::cref(mesh_vertex),_1,_2),
+     boost::bind(&TriangleMeshSubdividedIcosahedron::progress_step,this,_1)
+     );
+
+  progress_complete("Normals computed");
+}
+
+void TriangleMeshSubdividedIcosahedron::compute_vertex_normals_on_grid(const GeodesicGrid& grid,const std::vector<uint>& mesh_vertex,uint begin,uint end)
+{
+  std::vector<Triangle> around;
+  for (uint v=begin;v<end;v++)
+    {
+      around.clear();
+      grid.triangles_around(v,around);
+
+      XYZ n(0.0,0.0,0.0);
+      for (uint t=0;t<around.size();t++)
+        {
+          const XYZ& v0=vertex(mesh_vertex[around[t].vertex(0)]).position();
+          const XYZ& v1=vertex(mesh_vertex[around[t].vertex(1)]).position();
+          const XYZ& v2=vertex(mesh_vertex[around[t].vertex(2)]).position();
+          n+=((v1-v0)*(v2-v0)).normalised();
+        }
+      n/=around.size();
+
+      vertex(mesh_vertex[v]).normal(n);
+    }
 }
 
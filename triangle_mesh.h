@@ -33,6 +33,9 @@
   \brief Interface for class TriangleMesh.
 */
 
+class GeodesicGrid;
+class SubdivisionTopology;
+
 //! Contains vertices and triangles of a triangle mesh.
 /*! Abstract base class because specific classes must specify a geometry.
   Not as general-purpose as it might be due to constraints imposed by OpenGL.
@@ -110,6 +113,20 @@ public:
       vertex(i).position(p);
     }
 
+  //! Return height of a vertex in the given geometry (for use by stages templated on the geometry type).
+  template <class G> float vertex_height(const G& geometry,uint i) const
+    {
+      return geometry.height(vertex(i).position());
+    }
+
+  //! Set height of a vertex in the given geometry (for use by stages templated on the geometry type).
+  template <class G> void set_vertex_height(const G& geometry,uint i,float h)
+    {
+      XYZ p(vertex(i).position());
+      geometry.set_height(p,h);
+      vertex(i).position(p);
+    }
+
   //! Return minimum height of a triangle's vertices.
   float triangle_height_min(uint i) const
     {
@@ -179,19 +196,75 @@ public:
     }
 
   //! (Re-)computes vertex normals.
-  void compute_vertex_normals();
+  /*! Virtual so that meshes with a known regular structure can avoid building vertex-to-triangle lists.
+   */
+  virtual void compute_vertex_normals();
 
   //! Perform a single subdivision pass with perturbations up to the specified size
   void subdivide(const XYZ& variation,uint level,uint levels);
 
   //! Perform a number of subdivisions, possibly some unperturbed ("flat"), and halving the perturbation variation each iteration.
+  /*! Storage for the final mesh is sized exactly up front (see SubdivisionTopology for the counts and peak memory).
+   */
   void subdivide(uint subdivisions,uint flat_subdivisions,const XYZ& variation);
 
+  //! Numbering of the vertices an exporter writes: those referenced by the triangles it writes, in mesh order.
+  /*! When every vertex is referenced the numbering is the identity and no tables are kept.
+   */
+  class ExportedVertices
+  {
+  public:
+
+    //! Number the vertices referenced by the mesh's triangles [begin,end).
+    ExportedVertices(const TriangleMesh& mesh,uint begin,uint end);
+
+    //! Number of vertices written.
+    uint vertices() const
+      {
+        return _vertices;
+      }
+
+    //! Mesh vertex written as vertex i.
+    uint mesh_vertex(uint i) const
+      {
+        return (_mesh_vertex.empty() ? i : _mesh_vertex[i]);
+      }
+
+    //! Number mesh vertex v is written as (only meaningful for referenced vertices).
+    uint exported_vertex(uint v) const
+      {
+        return (_exported_vertex.empty() ? v : _exported_vertex[v]);
+      }
+
+  private:
+
+    //! Number of vertices written.
+    uint _vertices;
+
+    //! Mesh vertex of each written vertex (empty for the identity).
+    std::vector<uint> _mesh_vertex;
+
+    //! Written number of each mesh vertex (empty for the identity).
+    std::vector<uint> _exported_vertex;
+  };
+
   //! Dump the mesh to the file in a form suitable for use by POVRay.
-  void write_povray(std::ofstream& out,bool exclude_alternate_colour,bool double_illuminate,bool no_shadow) const;
+  /*! Only vertices referenced by the triangles written are written (so excluding the alternate colour drops pure-ocean vertices).
+    If palette_bits is non-zero, vertex colours are quantised to that many bits per channel (at most 8, for exact colours)
+    and each distinct colour written as a single shared texture, rather than a texture per vertex and colour.
+   */
+  void write_povray(std::ostream& out,bool exclude_alternate_colour,bool double_illuminate,bool no_shadow,uint palette_bits=0) const;
+
+  //! Dump the mesh to the file as binary (little-endian) PLY, with per-vertex normals and colours.
+  void write_ply(std::ostream& out,const std::string& mesh_name) const;
 
-  //! Dump the mesh to the file in a form suitable for use by Blender.
-  void write_blender(std::ofstream& out,const std::string& mesh_name,const FloatRGBA* fake_alpha) const;
+  //! Dump the mesh to the file as (ASCII) OBJ, with per-vertex normals and colours.
+  void write_obj(std::ostream& out,const std::string& mesh_name) const;
+
+  //! Dump the mesh to a binary data file, and a call loading it into Blender to the script.
+  /*! Only vertices referenced by some triangle are written.
+   */
+  void write_blender(std::ostream& out,const std::string& data_filename,const std::string& mesh_name,const FloatRGBA* fake_alpha) const;
 
  protected:
 
@@ -210,6 +283,12 @@ public:
   //! Pointer to the progress object to which progress reports should be made.
   Progress*const _progress;
 
+  //! Number of subdivision passes applied since construction.
+  /*! While triangles remain in the order subdivide() generated them,
+    triangle i is descended from base triangle i>>(2*_subdivisions).
+   */
+  uint _subdivisions;
+
   //! Accessor.
   Vertex& vertex(uint i)
     {
@@ -222,6 +301,28 @@ public:
       return _triangle[i];
     }
 
+  //! Perform topology.levels() subdivisions (the first flat_subdivisions unperturbed) using precomputed connectivity.
+  void subdivide(const SubdivisionTopology& topology,uint flat_subdivisions,const XYZ& variation);
+
+  //! Perturb the existing vertices and append the midpoints of the given edges (one level of subdivision).
+  void subdivide_vertices(const std::vector<std::pair<uint,uint> >& midpoints,const XYZ& variation,uint level,uint levels);
+
+  //! Body of subdivide_vertices, bound to a specific geometry type.
+  template <class G> void subdivide_vertices(const G& geometry,const std::vector<std::pair<uint,uint> >& midpoints,const XYZ& variation);
+
+  //! Coarsen regions of flagged triangles back up the subdivision hierarchy.
+  /*! Only valid while triangles are still in the order subdivide() generated them.
+    Each maximal fully-flagged node of the hierarchy is replaced by a single triangle,
+    unless that would let its centroid sag more than max_sag below its corners.
+    Neighbouring nodes are kept within one level of each other and coarse triangles are split
+    along any edge whose midpoint is used by a finer neighbour, so no cracks are introduced.
+    Unflagged triangles are appended to kept unchanged, the flagged region's triangles to merged.
+   */
+  void coarsen_triangles(const std::vector<bool>& flagged,float max_sag,std::vector<Triangle>& kept,std::vector<Triangle>& merged) const;
+
+  //! Remove vertices not referenced by any triangle, renumbering triangles to match.
+  void remove_unreferenced_vertices();
+
   //! Convenience wrapper with null test.
   void progress_start(uint steps,const std::string& info) const;
 
@@ -236,6 +337,40 @@ public:
 
  private:
 
+  //! Append POV-Ray vertex_vectors entries for exported vertices [begin,end) to s.
+  void format_povray_vertices(const ExportedVertices& exported,std::string& s,uint begin,uint end) const;
+
+  //! Append a POV-Ray texture_list entry for a colour to s.
+  void format_povray_texture(std::string& s,const ByteRGBA& colour) const;
+
+  //! Append POV-Ray texture_list entries [begin,end) to s.
+  /*! Entries [0,exported.vertices()) are the exported vertices' colour 0, any from exported.vertices() on their alternate colour.
+   */
+  void format_povray_textures(const ExportedVertices& exported,std::string& s,uint begin,uint end) const;
+
+  //! Append POV-Ray texture_list entries [begin,end) of a palette to s.
+  void format_povray_palette(const std::vector<ByteRGBA>& palette,std::string& s,uint begin,uint end) const;
+
+  //! Append POV-Ray face_indices entries for triangles [begin,end) to s.
+  /*! Textures are indexed as by format_povray_textures, mapped through texture_index if there is one.
+   */
+  void format_povray_faces(const ExportedVertices& exported,const std::vector<uint>* texture_index,std::string& s,uint begin,uint end) const;
+
+  //! Append binary PLY vertex entries for exported vertices [begin,end), with their colour c, to s.
+  void format_ply_vertices(const ExportedVertices& exported,uint c,std::string& s,uint begin,uint end) const;
+
+  //! Append binary PLY face entries for triangles first+[begin,end) to s, their vertices numbered from base by exported.
+  void format_ply_faces(const ExportedVertices& exported,uint first,uint base,std::string& s,uint begin,uint end) const;
+
+  //! Append OBJ vertex (v) lines for exported vertices [begin,end), with their colour c, to s.
+  void format_obj_vertices(const ExportedVertices& exported,uint c,std::string& s,uint begin,uint end) const;
+
+  //! Append OBJ normal (vn) lines for exported vertices [begin,end) to s.
+  void format_obj_normals(const ExportedVertices& exported,std::string& s,uint begin,uint end) const;
+
+  //! Append OBJ face (f) lines for triangles first+[begin,end) to s, their vertices (and normals) numbered from base by exported.
+  void format_obj_faces(const ExportedVertices& exported,uint first,uint base,std::string& s,uint begin,uint end) const;
+
   //! Fake per-vertex alpha for Blender.
   static ByteRGBA blender_alpha_workround(const ByteRGBA*,const ByteRGBA&);
 };
@@ -297,8 +432,18 @@ class TriangleMeshSubdividedIcosahedron : public TriangleMeshIcosahedron
   TriangleMeshSubdividedIcosahedron(float radius,uint subdivisions,uint flat_subdivisions,uint seed,const XYZ& variation,Progress* progress);
 
   //! Destructor.
-  ~TriangleMeshSubdividedIcosahedron()
-    {}
+  ~TriangleMeshSubdividedIcosahedron();
+
+  //! (Re-)computes vertex normals, from the geodesic grid while the vertices are still numbered as subdivision left them.
+  virtual void compute_vertex_normals();
+
+ private:
+
+  //! Compute normals of grid vertices in range (mesh_vertex maps grid to mesh vertices).
+  void compute_vertex_normals_on_grid(const GeodesicGrid& grid,const std::vector<uint>& mesh_vertex,uint begin,uint end);
+
+  //! Connectivity shared with any other icosahedra subdivided to the same level (e.g terrain and clouds).
+  const boost::shared_ptr<const SubdivisionTopology> _topology;
 };
 
 #endif
@@ -23,7 +23,9 @@
 
 #include "noise.h"
 #include "matrix34.h"
+#include "parallel.h"
 #include "parameters_render.h"
+#include "texture_renderer.h"
 
 TriangleMeshCloud::TriangleMeshCloud(Progress* progress)
   :TriangleMesh(progress)
@@ -32,72 +34,125 @@ TriangleMeshCloud::TriangleMeshCloud(Progress* progress)
 TriangleMeshCloud::~TriangleMeshCloud()
 {}
 
-void TriangleMeshCloud::write_povray(std::ofstream& out,const ParametersSave&,const ParametersCloud&) const
+void TriangleMeshCloud::write_povray(std::ostream& out,const ParametersSave& parameters_save,const ParametersCloud&) const
 {
   // Double illuminate so underside of clouds is white.
   // No-shadow so clouds don't cast crazy dark shadows.
-  TriangleMesh::write_povray(out,false,true,true);
+  TriangleMesh::write_povray(out,false,true,true,(parameters_save.pov_palette ? parameters_save.pov_palette_bits : 0));
 }
 
-void TriangleMeshCloud::write_blender(std::ofstream& out,const ParametersSave& parameters_save,const ParametersCloud&,const std::string& mesh_name) const
+void TriangleMeshCloud::write_blender(std::ostream& out,const std::string& filename_base,const ParametersSave& parameters_save,const ParametersCloud&,const std::string& mesh_name) const
 {
   TriangleMesh::write_blender
     (
      out,
+     filename_base+"_cloud.bin",
      mesh_name+".cloud",
      (parameters_save.blender_per_vertex_alpha ? 0 : &parameters_save.parameters_render->background_colour_low)
      );
 }
 
+void TriangleMeshCloud::write_gltf(GltfWriter& gltf,const std::string& mesh_name) const
+{
+  gltf.add(*this,mesh_name+".cloud",true);
+}
+
+void TriangleMeshCloud::write_mesh(std::ostream& out,const ParametersSave& parameters_save,const std::string& mesh_name) const
+{
+  if (parameters_save.mesh_obj)
+    write_obj(out,mesh_name+".cloud");
+  else
+    write_ply(out,mesh_name+".cloud");
+}
+
+/*! Triangles are rendered in parallel by horizontal bands of the image (see TextureRenderer).
+ */
+void TriangleMeshCloud::render_texture(Raster<uchar>& image) const
+{
+  progress_start(100,"Generating cloud texture");
+
+  const CloudTextureLayer layer(*this);
+  TextureRenderer<CloudTextureLayer> renderer(layer,image.width(),image.height());
+  renderer.find_extents();
+
+  image.fill(0);
+  const std::vector<uint> all(renderer.all());
+  const CloudTextureTarget target(TextureRows(image.width(),image.height(),0,0,image.height()),image);
+
+  parallel_for
+    (
+     image.height(),
+     boost::bind(&TextureRenderer<CloudTextureLayer>::render_rows,&renderer,boost::cref(all),boost::cref(target),_1,_2),
+     boost::bind(&TriangleMeshCloud::progress_step,this,_1)
+     );
+
+  progress_complete("Cloud texture generation completed");
+}
+
 namespace
 {
-  class ScanConvertHelper : public ScanConvertBackend
+  //! Flags triangles whose vertices all have zero alpha (and so contribute nothing to the cloud layer).
+  class FlagTransparentTriangles
   {
   public:
-    ScanConvertHelper(Raster<uchar>& image,const boost::array<float,3>& vertex_colours)
-      :ScanConvertBackend(image.width(),image.height())
-      ,_image(image)
-      ,_vertex_colours(vertex_colours)
-    {}
-    virtual ~ScanConvertHelper()
-    {}
-    virtual void scan_convert_backend(uint /*y*/,const ScanEdge& /*edge0*/,const ScanEdge& /*edge1*/) const
-    {}
-    virtual void subdivide(const boost::array<XYZ,3>& /*v*/,const XYZ& /*m*/,const ScanConverter& /*scan_converter*/) const
+    FlagTransparentTriangles(const TriangleMesh& mesh,std::vector<uchar>& transparent)
+      :_mesh(mesh)
+      ,_transparent(transparent)
     {}
+    void operator()(uint begin,uint end) const
+    {
+      for (uint t=begin;t<end;t++)
+        {
+          const Triangle& tri=_mesh.triangle(t);
+          _transparent[t]=
+            (
+             _mesh.vertex(tri.vertex(0)).colour(0).a==0
+             && _mesh.vertex(tri.vertex(1)).colour(0).a==0
+             && _mesh.vertex(tri.vertex(2)).colour(0).a==0
+             );
+        }
+    }
   private:
-    Raster<uchar>& _image;
-    const boost::array<float,3>& _vertex_colours;
+    const TriangleMesh& _mesh;
+    std::vector<uchar>& _transparent;
   };
 }
 
-void TriangleMeshCloud::render_texture(Raster<uchar>& image) const
+void TriangleMeshCloud::remove_transparent_triangles()
 {
-  assert(false);
-  image.fill(0);
-  for (uint i=0;i<triangles();i++)
-    {
-      const Triangle& t=triangle(i);
-      const boost::array<XYZ,3> vertex_positions
-    ={{
-      vertex(t.vertex(0)).position(),
-      vertex(t.vertex(1)).position(),
-      vertex(t.vertex(2)).position()
-    }};
-      const boost::array<float,3> vertex_colours
-    ={{
-      FloatRGBA(vertex(t.vertex(0)).colour(0)).a,
-      FloatRGBA(vertex(t.vertex(1)).colour(0)).a,
-      FloatRGBA(vertex(t.vertex(2)).colour(0)).a
-    }};
-
-      ScanConvertHelper scan_convert_backend(image,vertex_colours);
-      geometry().scan_convert
+  progress_start(100,"Removing transparent cloud");
+
+  const uint initial_triangles=triangles();
+  const uint initial_vertices=vertices();
+
+  std::vector<uchar> transparent(triangles());
+  parallel_for
     (
-     vertex_positions,
-     scan_convert_backend
+     triangles(),
+     FlagTransparentTriangles(*this,transparent),
+     boost::bind(&TriangleMeshCloud::progress_step,this,_1)
      );
+
+  // Leave the mesh alone if there'd be nothing left of it.
+  if (std::find(transparent.begin(),transparent.end(),0)==transparent.end())
+    {
+      progress_complete("No cloud triangles are visible; none removed");
+      return;
     }
+
+  uint n=0;
+  for (uint t=0;t<triangles();t++)
+    if (!transparent[t])
+      _triangle[n++]=_triangle[t];
+  _triangle.erase(_triangle.begin()+n,_triangle.end());
+
+  remove_unreferenced_vertices();
+
+  std::ostringstream msg;
+  msg
+    << "Removed " << initial_triangles-triangles() << " of " << initial_triangles << " cloud triangles"
+    << " and " << initial_vertices-vertices() << " of " << initial_vertices << " vertices (fully transparent)";
+  progress_complete(msg.str());
 }
 
 void TriangleMeshCloud::do_cloud(const ParametersCloud& parameters)
@@ -127,9 +182,6 @@ void TriangleMeshCloud::do_cloud(const ParametersCloud& parameters)
     }
   progress_complete("Cloud colouring completed");
 
-  // TODO: Eliminate all-transparent triangles & unused vertices.
-  // Leave if nothing left
-
   // TODO: Bias weather into temperate bands (maybe not)
 
   progress_start(100,"Weather systems");
@@ -173,6 +225,10 @@ void TriangleMeshCloud::do_cloud(const ParametersCloud& parameters)
 
   progress_complete("Weather systems completed");
 
+  // Weather systems only move vertices, so this could be done before them,
+  // but they pick vertices at random by index and the clouds would then change.
+  remove_transparent_triangles();
+
   _triangle_switch_colour=triangles();
 }
 
@@ -24,6 +24,7 @@
 #ifndef _triangle_mesh_cloud_h_
 #define _triangle_mesh_cloud_h_
 
+#include "gltf_writer.h"
 #include "image.h"
 #include "parameters_cloud.h"
 #include "triangle_mesh.h"
@@ -44,10 +45,16 @@ class TriangleMeshCloud : virtual public TriangleMesh
   ~TriangleMeshCloud();
 
   //! Dump mesh to file for POV-Ray
-  void write_povray(std::ofstream& out,const ParametersSave&,const ParametersCloud&) const;
+  void write_povray(std::ostream& out,const ParametersSave&,const ParametersCloud&) const;
 
-  //! Dump mesh to file for Blender
-  void write_blender(std::ofstream& out,const ParametersSave&,const ParametersCloud&,const std::string& mesh_name) const;
+  //! Dump mesh to file for Blender (its data going to filename_base+"_cloud.bin").
+  void write_blender(std::ostream& out,const std::string& filename_base,const ParametersSave&,const ParametersCloud&,const std::string& mesh_name) const;
+
+  //! Add mesh to a glTF file (with per-vertex alpha)
+  void write_gltf(GltfWriter& gltf,const std::string& mesh_name) const;
+
+  //! Dump mesh as PLY or OBJ (as selected by the save parameters).
+  void write_mesh(std::ostream& out,const ParametersSave&,const std::string& mesh_name) const;
 
   //! Render the mesh onto a raster image.
   /*! The only interesting thing with clouds is their alpha, so render a greyscale.
@@ -56,6 +63,11 @@ class TriangleMeshCloud : virtual public TriangleMesh
 
  protected:
 
+  //! Drop triangles with all vertices fully transparent, and then any vertices no longer used.
+  /*! Does nothing if no triangles would be left.
+   */
+  void remove_transparent_triangles();
+
   void do_cloud(const ParametersCloud& parameters);
 };
 
@@ -0,0 +1,451 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+#include "precompiled.h"
+
+#include "triangle_mesh_decimated.h"
+
+#include "parallel.h"
+
+namespace
+{
+  //! Symmetric 4x4 matrix accumulating the squared distances of a point to a set of planes.
+  class Quadric
+  {
+  public:
+
+    //! Null constructor: the empty set of planes.
+    Quadric()
+    {
+      std::fill(_q,_q+10,0.0);
+    }
+
+    //! Quadric of the plane through p with unit normal n.
+    Quadric(const XYZ& n,const XYZ& p)
+    {
+      const double a=n.x;
+      const double b=n.y;
+      const double c=n.z;
+      const double d=-(n%p);
+      _q[0]=a*a;_q[1]=a*b;_q[2]=a*c;_q[3]=a*d;
+      _q[4]=b*b;_q[5]=b*c;_q[6]=b*d;
+      _q[7]=c*c;_q[8]=c*d;
+      _q[9]=d*d;
+    }
+
+    //! Union of plane sets.
+    void operator+=(const Quadric& q)
+    {
+      for (uint i=0;i<10;i++) _q[i]+=q._q[i];
+    }
+
+    //! Sum of squared distances of p to the planes.
+    double operator()(const XYZ& p) const
+    {
+      const double x=p.x;
+      const double y=p.y;
+      const double z=p.z;
+      return
+        _q[0]*x*x+2.0*(_q[1]*x*y+_q[2]*x*z+_q[3]*x)
+        +_q[4]*y*y+2.0*(_q[5]*y*z+_q[6]*y)
+        +_q[7]*z*z+2.0*_q[8]*z
+        +_q[9];
+    }
+
+  private:
+
+    double _q[10];
+  };
+
+  //! Working state for decimating a triangle array in place.
+  /*! Per-vertex and per-triangle flags are uchar rather than bool so that threads can write neighbouring elements.
+   */
+  class Decimator : public boost::noncopyable
+  {
+  public:
+
+    Decimator(const std::vector<Vertex>& vertex,std::vector<Triangle>& triangle,uint& triangle_switch_colour,const std::vector<bool>& locked)
+      :_vertex(vertex)
+      ,_triangle(triangle)
+      ,_triangle_switch_colour(triangle_switch_colour)
+      ,_locked(locked.begin(),locked.end())
+      ,_quadric(vertex.size())
+      ,_target(vertex.size())
+      ,_cost(vertex.size())
+      ,_pass(0)
+      ,_changed(vertex.size(),0)
+    {
+      build_rings();
+      parallel_for(_vertex.size(),boost::bind(&Decimator::compute_quadrics,this,_1,_2));
+    }
+
+    //! Perform one pass of collapses no costlier than max_cost, stopping at target_triangles (if non-zero).
+    /*! Returns false if no collapse was possible.
+     */
+    bool pass(uint target_triangles,double max_cost)
+    {
+      parallel_for(_vertex.size(),boost::bind(&Decimator::evaluate,this,_1,_2));
+
+      std::vector<uint> candidates;
+      for (uint u=0;u<_vertex.size();u++)
+        if (_target[u]!=none && _cost[u]<=max_cost) candidates.push_back(u);
+      if (candidates.empty()) return false;
+
+      // Each collapse of an interior vertex removes two triangles.
+      // Only consider the cheapest quarter each pass so collapses are still made roughly in order of cost.
+      uint wanted=std::max(1u,static_cast<uint>(candidates.size()/4));
+      if (target_triangles) wanted=std::min(wanted,(static_cast<uint>(_triangle.size())-target_triangles+1)/2);
+      const CostLess cost_less(_cost);
+      if (wanted<candidates.size())
+        {
+          std::nth_element(candidates.begin(),candidates.begin()+wanted,candidates.end(),cost_less);
+          candidates.resize(wanted);
+        }
+      std::sort(candidates.begin(),candidates.end(),cost_less);
+
+      // Greedily accept collapses whose neighbourhoods don't overlap any already accepted,
+      // so that they can be applied concurrently and remain valid when they are.
+      _accepted.clear();
+      std::vector<uchar> marked(_vertex.size(),0);
+      std::vector<uint> scratch;
+      for (uint i=0;i<candidates.size();i++)
+        {
+          const uint u=candidates[i];
+          const uint v=_target[u];
+          if (marked[u] || marked[v]) continue;
+
+          scratch.clear();
+          neighbours(u,scratch);
+          neighbours(v,scratch);
+          scratch.push_back(u);
+
+          bool clear=true;
+          for (uint j=0;j<scratch.size() && clear;j++)
+            clear=!marked[scratch[j]];
+          if (!clear) continue;
+
+          for (uint j=0;j<scratch.size();j++)
+            marked[scratch[j]]=1;
+          _accepted.push_back(u);
+        }
+
+      _dead.assign(_triangle.size(),0);
+      parallel_for(_accepted.size(),boost::bind(&Decimator::collapse,this,_1,_2));
+
+      // Compact surviving triangles, preserving order (and so the colour split).
+      uint n=0;
+      uint switch_colour=0;
+      for (uint t=0;t<_triangle.size();t++)
+        if (!_dead[t])
+          {
+            if (t<_triangle_switch_colour) switch_colour++;
+            _triangle[n++]=_triangle[t];
+          }
+      _triangle.erase(_triangle.begin()+n,_triangle.end());
+      _triangle_switch_colour=switch_colour;
+
+      build_rings();
+
+      // Collapsing u into v changes the quadric of v and the neighbourhoods of v and its (new) 1-ring,
+      // so collapses from or to those vertices need re-evaluating next pass.
+      _pass++;
+      for (uint i=0;i<_accepted.size();i++)
+        {
+          const uint v=_target[_accepted[i]];
+          _target[_accepted[i]]=none;
+          scratch.clear();
+          neighbours(v,scratch);
+          _changed[v]=_pass;
+          for (uint j=0;j<scratch.size();j++)
+            _changed[scratch[j]]=_pass;
+        }
+
+      return true;
+    }
+
+  private:
+
+    static const uint none;
+
+    //! Orders vertices by the cost of their best collapse.
+    class CostLess
+    {
+    public:
+      CostLess(const std::vector<double>& cost)
+        :_cost(cost)
+      {}
+      bool operator()(uint a,uint b) const
+      {
+        return _cost[a]<_cost[b];
+      }
+    private:
+      const std::vector<double>& _cost;
+    };
+
+    //! Triangles around vertex v are _ring[_ring_begin[v]] to _ring[_ring_begin[v+1]-1].
+    void build_rings()
+    {
+      _ring_begin.assign(_vertex.size()+1,0);
+      for (uint t=0;t<_triangle.size();t++)
+        for (uint i=0;i<3;i++)
+          _ring_begin[_triangle[t].vertex(i)+1]++;
+      std::partial_sum(_ring_begin.begin(),_ring_begin.end(),_ring_begin.begin());
+
+      _ring.resize(3*_triangle.size());
+      std::vector<uint> fill(_ring_begin.begin(),_ring_begin.end()-1);
+      for (uint t=0;t<_triangle.size();t++)
+        for (uint i=0;i<3;i++)
+          _ring[fill[_triangle[t].vertex(i)]++]=t;
+    }
+
+    uint colour_of(uint t) const
+    {
+      return (t<_triangle_switch_colour ? 0 : 1);
+    }
+
+    //! Append the vertices sharing a triangle with v (with repeats: interior neighbours appear twice).
+    void neighbours(uint v,std::vector<uint>& out) const
+    {
+      for (uint r=_ring_begin[v];r<_ring_begin[v+1];r++)
+        for (uint i=0;i<3;i++)
+          {
+            const uint w=_triangle[_ring[r]].vertex(i);
+            if (w!=v) out.push_back(w);
+          }
+    }
+
+    const XYZ triangle_normal(uint v0,uint v1,uint v2) const
+    {
+      const XYZ& p0=_vertex[v0].position();
+      return (_vertex[v1].position()-p0)*(_vertex[v2].position()-p0);
+    }
+
+    void compute_quadrics(uint begin,uint end)
+    {
+      for (uint v=begin;v<end;v++)
+        for (uint r=_ring_begin[v];r<_ring_begin[v+1];r++)
+          {
+            const Triangle& t=_triangle[_ring[r]];
+            const XYZ n(triangle_normal(t.vertex(0),t.vertex(1),t.vertex(2)));
+            const float m=n.magnitude();
+            if (m>0.0f) _quadric[v]+=Quadric(n/m,_vertex[t.vertex(0)].position());
+          }
+    }
+
+    //! Reusable buffers for best_collapse.
+    struct Scratch
+    {
+      std::vector<uint> nu;
+      std::vector<uint> nv;
+      std::vector<uchar> shared;
+      std::vector<XYZ> normal;
+      std::vector<std::pair<double,uint> > order;
+    };
+
+    //! Find the cheapest valid collapse of u (considering only target only, if that isn't none).
+    /*! Returns the target vertex, or none if u can't be collapsed.
+     */
+    uint best_collapse(uint u,uint only,double& best,Scratch& scratch) const
+    {
+      best=std::numeric_limits<double>::max();
+      if (_locked[u] || _ring_begin[u]==_ring_begin[u+1]) return none;
+
+      // Vertices on the coastline stay put.
+      const uint colour=colour_of(_ring[_ring_begin[u]]);
+      for (uint r=_ring_begin[u]+1;r<_ring_begin[u+1];r++)
+        if (colour_of(_ring[r])!=colour) return none;
+
+      // So do vertices on the mesh boundary (or anywhere non-manifold):
+      // an interior vertex sees each neighbour in exactly two of its triangles.
+      std::vector<uint>& nu=scratch.nu;
+      nu.clear();
+      neighbours(u,nu);
+      std::sort(nu.begin(),nu.end());
+      for (uint i=0;i<nu.size();i+=2)
+        if (!(i+1<nu.size() && nu[i]==nu[i+1] && (i+2==nu.size() || nu[i+2]!=nu[i]))) return none;
+      nu.erase(std::unique(nu.begin(),nu.end()),nu.end());
+
+      // Try the targets cheapest first: usually the first is valid, which saves testing the rest.
+      std::vector<std::pair<double,uint> >& order=scratch.order;
+      order.clear();
+      for (uint i=0;i<nu.size();i++)
+        if (only==none || nu[i]==only)
+          {
+            const XYZ& p=_vertex[nu[i]].position();
+            order.push_back(std::make_pair(_quadric[u](p)+_quadric[nu[i]](p),nu[i]));
+          }
+      std::sort(order.begin(),order.end());
+
+      std::vector<XYZ>& normal=scratch.normal;
+      normal.clear();
+      for (uint r=_ring_begin[u];r<_ring_begin[u+1];r++)
+        {
+          const Triangle& t=_triangle[_ring[r]];
+          normal.push_back(triangle_normal(t.vertex(0),t.vertex(1),t.vertex(2)));
+        }
+
+      for (uint i=0;i<order.size();i++)
+        {
+          const uint v=order[i].second;
+
+          // Link condition: u and v may only share the two neighbours opposite their common edge,
+          // otherwise the collapse would make the mesh non-manifold.
+          // Rings are small, so a linear search beats sorting here.
+          std::vector<uint>& nv=scratch.nv;
+          nv.clear();
+          neighbours(v,nv);
+          scratch.shared.assign(nu.size(),0);
+          for (uint j=0;j<nv.size();j++)
+            {
+              const std::vector<uint>::const_iterator it=std::find(nu.begin(),nu.end(),nv[j]);
+              if (it!=nu.end()) scratch.shared[it-nu.begin()]=1;
+            }
+          if (std::count(scratch.shared.begin(),scratch.shared.end(),1)!=2) continue;
+
+          // Reject collapses which would flip (or nearly flip) a triangle:
+          // the angle between old and new normals must stay under about 75 degrees.
+          bool flips=false;
+          for (uint r=_ring_begin[u];r<_ring_begin[u+1] && !flips;r++)
+            {
+              const Triangle& t=_triangle[_ring[r]];
+              if (t.vertex(0)==v || t.vertex(1)==v || t.vertex(2)==v) continue;
+
+              boost::array<uint,3> moved={{t.vertex(0),t.vertex(1),t.vertex(2)}};
+              for (uint j=0;j<3;j++) if (moved[j]==u) moved[j]=v;
+
+              const XYZ& n_old=normal[r-_ring_begin[u]];
+              const XYZ n_new(triangle_normal(moved[0],moved[1],moved[2]));
+              const float d=n_old%n_new;
+              flips=(d<=0.0f || d*d<=0.0625f*n_old.magnitude2()*n_new.magnitude2());
+            }
+          if (flips) continue;
+
+          best=order[i].first;
+          return v;
+        }
+      return none;
+    }
+
+    //! Find the cheapest valid collapse for each vertex in range whose neighbourhood, or whose target's, changed last pass.
+    /*! The validity of a collapse depends only on the neighbourhoods of its two ends.
+     */
+    void evaluate(uint begin,uint end)
+    {
+      Scratch scratch;
+      for (uint u=begin;u<end;u++)
+        if (_changed[u]==_pass || (_target[u]!=none && _changed[_target[u]]==_pass))
+          _target[u]=best_collapse(u,none,_cost[u],scratch);
+    }
+
+    //! Apply accepted collapses in range.
+    void collapse(uint begin,uint end)
+    {
+      for (uint i=begin;i<end;i++)
+        {
+          const uint u=_accepted[i];
+          const uint v=_target[u];
+          for (uint r=_ring_begin[u];r<_ring_begin[u+1];r++)
+            {
+              const uint t=_ring[r];
+              const Triangle& old_triangle=_triangle[t];
+              if (old_triangle.vertex(0)==v || old_triangle.vertex(1)==v || old_triangle.vertex(2)==v)
+                {
+                  _dead[t]=1;
+                }
+              else
+                {
+                  boost::array<uint,3> moved={{old_triangle.vertex(0),old_triangle.vertex(1),old_triangle.vertex(2)}};
+                  for (uint j=0;j<3;j++) if (moved[j]==u) moved[j]=v;
+                  _triangle[t]=Triangle(moved[0],moved[1],moved[2]);
+                }
+            }
+          _quadric[v]+=_quadric[u];
+        }
+    }
+
+    const std::vector<Vertex>& _vertex;
+    std::vector<Triangle>& _triangle;
+    uint& _triangle_switch_colour;
+
+    const std::vector<uchar> _locked;
+    std::vector<Quadric> _quadric;
+
+    std::vector<uint> _ring_begin;
+    std::vector<uint> _ring;
+
+    //! Best collapse target for each vertex (or none), and its cost.
+    std::vector<uint> _target;
+    std::vector<double> _cost;
+
+    //! Number of passes made, and the last pass in which each vertex's neighbourhood changed.
+    uint _pass;
+    std::vector<uint> _changed;
+
+    //! Vertices to be collapsed (into their _target) this pass.
+    std::vector<uint> _accepted;
+
+    //! Triangles removed this pass.
+    std::vector<uchar> _dead;
+  };
+
+  const uint Decimator::none=static_cast<uint>(-1);
+}
+
+TriangleMeshDecimated::TriangleMeshDecimated(const TriangleMesh& source,const std::vector<bool>& locked,uint target_triangles,float max_error,Progress* progress)
+  :TriangleMesh(progress)
+  ,_source(source)
+{
+  _vertex.reserve(source.vertices());
+  for (uint v=0;v<source.vertices();v++)
+    add_vertex(source.vertex(v));
+  _triangle.reserve(source.triangles());
+  for (uint t=0;t<source.triangles();t++)
+    add_triangle(source.triangle(t));
+  _triangle_switch_colour=source.triangles_of_colour0();
+  set_emissive(source.emissive());
+
+  if (target_triangles==0 && max_error==0.0f) return;
+
+  progress_start(100,"Decimating mesh");
+
+  const uint initial_triangles=triangles();
+  const double max_cost=(max_error==0.0f ? std::numeric_limits<double>::max() : static_cast<double>(max_error)*max_error);
+
+  {
+    Decimator decimator(_vertex,_triangle,_triangle_switch_colour,locked);
+    uint passes=0;
+    while ((target_triangles==0 || triangles()>target_triangles) && decimator.pass(target_triangles,max_cost))
+      {
+        passes++;
+        if (target_triangles && initial_triangles>target_triangles)
+          progress_step((100*(initial_triangles-triangles()))/(initial_triangles-target_triangles));
+        else
+          progress_step(std::min(99u,passes));
+      }
+  }
+
+  remove_unreferenced_vertices();
+
+  std::ostringstream msg;
+  msg << "Decimated mesh from " << initial_triangles << " to " << triangles() << " triangles";
+  progress_complete(msg.str());
+}
+
+TriangleMeshDecimated::~TriangleMeshDecimated()
+{}
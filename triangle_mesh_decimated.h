@@ -0,0 +1,64 @@
+/**************************************************************************/
+/*  Copyright 2009 Tim Day                                                */
+/*                                                                        */
+/*  This file is part of Fracplanet                                       */
+/*                                                                        */
+/*  Fracplanet is free software: you can redistribute it and/or modify    */
+/*  it under the terms of the GNU General Public License as published by  */
+/*  the Free Software Foundation, either version 3 of the License, or     */
+/*  (at your option) any later version.                                   */
+/*                                                                        */
+/*  Fracplanet is distributed in the hope that it will be useful,         */
+/*  but WITHOUT ANY WARRANTY; without even the implied warranty of        */
+/*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         */
+/*  GNU General Public License for more details.                          */
+/*                                                                        */
+/*  You should have received a copy of the GNU General Public License     */
+/*  along with Fracplanet.  If not, see <http://www.gnu.org/licenses/>.   */
+/**************************************************************************/
+
+/*! \file
+  \brief Interface for class TriangleMeshDecimated.
+*/
+
+#ifndef _triangle_mesh_decimated_h_
+#define _triangle_mesh_decimated_h_
+
+#include "triangle_mesh.h"
+
+//! A copy of another mesh, reduced by quadric-error-metric edge collapses.
+/*! Collapses are "half-edge" (a vertex merges into one of its neighbours),
+  so surviving vertices keep their exact positions, normals and colours.
+  Vertices on the mesh boundary, on the boundary between colour-0 and colour-1 triangles,
+  or flagged as locked by the caller are never removed,
+  so coastlines (and, for terrain, river networks) are preserved exactly.
+  Each pass evaluates collapse costs in parallel, selects a set of the cheapest collapses
+  with disjoint neighbourhoods, and applies those in parallel too.
+ */
+class TriangleMeshDecimated : public TriangleMesh
+{
+ public:
+
+  //! Constructor.
+  /*! Decimates until no more than target_triangles remain (0 for no budget),
+    or until no collapse is possible without exceeding max_error (0 for no limit).
+    The error is measured as the root of the summed squared distances to the planes of the original triangles merged into a vertex.
+   */
+  TriangleMeshDecimated(const TriangleMesh& source,const std::vector<bool>& locked,uint target_triangles,float max_error,Progress* progress);
+
+  //! Destructor.
+  ~TriangleMeshDecimated();
+
+  //! Returns the geometry of the source mesh.
+  virtual const Geometry& geometry() const
+    {
+      return _source.geometry();
+    }
+
+ private:
+
+  //! The mesh this is a decimated copy of.
+  const TriangleMesh& _source;
+};
+
+#endif
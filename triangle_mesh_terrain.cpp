@@ -22,6 +22,9 @@
 #include "triangle_mesh_terrain.h"
 
 #include "noise.h"
+#include "parallel.h"
+#include "texture_renderer.h"
+#include "triangle_mesh_decimated.h"
 
 TriangleMeshTerrain::TriangleMeshTerrain(Progress* progress)
   :TriangleMesh(progress)
@@ -32,6 +35,42 @@ TriangleMeshTerrain::~TriangleMeshTerrain()
 {}
 
 
+void TriangleMeshTerrain::cache_heights()
+{
+  heights.resize(vertices());
+  if (const GeometrySpherical*const g=dynamic_cast<const GeometrySpherical*>(&geometry()))
+    cache_heights(GeometryStatic<GeometrySpherical>(*g));
+  else if (const GeometryFlat*const g=dynamic_cast<const GeometryFlat*>(&geometry()))
+    cache_heights(GeometryStatic<GeometryFlat>(*g));
+  else
+    cache_heights(geometry());
+}
+
+template <class G> void TriangleMeshTerrain::cache_heights(const G& geometry)
+{
+  for (uint i=0;i<vertices();i++)
+    heights[i]=vertex_height(geometry,i);
+}
+
+void TriangleMeshTerrain::materialise_heights()
+{
+  assert(heights.size()==vertices());
+  if (const GeometrySpherical*const g=dynamic_cast<const GeometrySpherical*>(&geometry()))
+    materialise_heights(GeometryStatic<GeometrySpherical>(*g));
+  else if (const GeometryFlat*const g=dynamic_cast<const GeometryFlat*>(&geometry()))
+    materialise_heights(GeometryStatic<GeometryFlat>(*g));
+  else
+    materialise_heights(geometry());
+}
+
+template <class G> void TriangleMeshTerrain::materialise_heights(const G& geometry)
+{
+  for (uint i=0;i<vertices();i++)
+    set_vertex_height(geometry,i,heights[i]);
+}
+
+/*! Noise is sampled at the (not yet displaced) vertex positions and accumulated into the height channel.
+ */
 void TriangleMeshTerrain::do_noise(const ParametersTerrain& parameters)
 {
   if (parameters.noise.terms==0 || parameters.noise.amplitude==0) return;
@@ -41,22 +80,19 @@ void TriangleMeshTerrain::do_noise(const ParametersTerrain& parameters)
 
   progress_start(100,"Noise");
 
-  MultiscaleNoise noise(parameters.seed,parameters.noise.terms,parameters.noise.amplitude_decay);
+  const MultiscaleNoise noise(parameters.seed,parameters.noise.terms,parameters.noise.amplitude_decay);
   for (uint i=0;i<vertices();i++)
     {
       step++;
       progress_step((100*step)/steps);
 
-      const float h=vertex_height(i);
-      const float p=parameters.noise.amplitude*noise(parameters.noise.frequency*vertex(i).position());
-
-      set_vertex_height(i,h+p);
+      heights[i]+=parameters.noise.amplitude*noise(parameters.noise.frequency*vertex(i).position());
     }
 
   progress_complete("Noise complete");
 }
 
-void TriangleMeshTerrain::do_sea_level(const ParametersTerrain& /*parameters*/)
+void TriangleMeshTerrain::do_sea_level(const ParametersTerrain& parameters)
 {
   // Introduce sea level
   const uint steps=vertices()+triangles();
@@ -71,18 +107,18 @@ void TriangleMeshTerrain::do_sea_level(const ParametersTerrain& /*parameters*/)
     step++;
     progress_step((100*step)/steps);
 
-    const float m=vertex_height(i);
+    const float m=heights[i];
 
     if (m<=0.0)
       {
-        set_vertex_height(i,0.0);
+        heights[i]=0.0;
         sea_vertices[i]=true;
       }
     else if (m>max_height)
       max_height=m;
       }
 
-    std::vector<Triangle> land_sea[2];
+    std::vector<bool> is_sea_triangle(triangles());
 
     for (uint i=0;i<triangles();i++)
       {
@@ -90,12 +126,35 @@ void TriangleMeshTerrain::do_sea_level(const ParametersTerrain& /*parameters*/)
     progress_step((100*step)/steps);
 
     const Triangle& t=triangle(i);
-    land_sea[sea_vertices[t.vertex(0)] && sea_vertices[t.vertex(1)] && sea_vertices[t.vertex(2)]].push_back(t);
+    is_sea_triangle[i]=(sea_vertices[t.vertex(0)] && sea_vertices[t.vertex(1)] && sea_vertices[t.vertex(2)]);
+      }
+
+    std::vector<Triangle> land_sea[2];
+
+    if (parameters.simplify_oceans)
+      {
+    // The flat ocean gains nothing from full subdivision density, so merge it back into coarser triangles.
+    // Limit the sag of the merged (chordal) surface below sea level to a small fraction of the terrain height.
+    // Coarsening measures the sag from positions, so bring them up to date first.
+    const float ocean_sag=0.01f;
+    materialise_heights();
+    coarsen_triangles(is_sea_triangle,ocean_sag*max_height,land_sea[0],land_sea[1]);
+      }
+    else
+      {
+    for (uint i=0;i<triangles();i++)
+      land_sea[is_sea_triangle[i]].push_back(triangle(i));
       }
 
     _triangle_switch_colour=land_sea[0].size();
     _triangle=land_sea[0];
     _triangle.insert(_triangle.end(),land_sea[1].begin(),land_sea[1].end());
+
+    if (parameters.simplify_oceans)
+      {
+    remove_unreferenced_vertices();
+    cache_heights();
+      }
   }
   progress_complete("Sea level completed");
 }
@@ -107,14 +166,15 @@ void TriangleMeshTerrain::do_power_law(const ParametersTerrain& parameters)
 
   progress_start(100,"Power law");
 
+  const float epsilon=geometry().epsilon();
   for (uint i=0;i<vertices();i++)
     {
       step++;
       progress_step((100*step)/steps);
 
-      const float h=vertex_height(i);
-      if (h>geometry().epsilon())
-    set_vertex_height(i,max_height*pow(h/max_height,parameters.power_law));
+      const float h=heights[i];
+      if (h>epsilon)
+    heights[i]=max_height*pow(h/max_height,parameters.power_law);
     }
 
   progress_complete("Power law completed");
@@ -200,7 +260,7 @@ void TriangleMeshTerrain::do_rivers(const ParametersTerrain& parameters)
     continue;
 
       current_vertices.insert(source_vertex);
-      current_vertices_height=vertex_height(source_vertex);
+      current_vertices_height=heights[source_vertex];
 
       while(true)
     {
@@ -227,7 +287,7 @@ void TriangleMeshTerrain::do_rivers(const ParametersTerrain& parameters)
       std::multimap<float,uint> flow_candidates;
       for (std::set<uint>::const_iterator it=current_vertices_neighbours.begin();it!=current_vertices_neighbours.end();it++)
         {
-          flow_candidates.insert(std::multimap<float,uint>::value_type(vertex_height(*it),*it));
+          flow_candidates.insert(std::multimap<float,uint>::value_type(heights[*it],*it));
         }
 
       if (reached_sea)
@@ -295,7 +355,7 @@ void TriangleMeshTerrain::do_rivers(const ParametersTerrain& parameters)
         {
           const uint v=(*it).second;
           current_vertices.insert(v);
-          set_vertex_height(v,current_vertices_height);
+          heights[v]=current_vertices_height;
         }
           vertices_to_add_by_height.erase(vertices_to_add_by_height.begin(),backflow_end);
 
@@ -303,7 +363,7 @@ void TriangleMeshTerrain::do_rivers(const ParametersTerrain& parameters)
           // Also count vertices rather than having .size() iterate over them again.
           for (std::set<uint>::const_iterator it=current_vertices.begin();it!=current_vertices.end();it++)
         {
-          set_vertex_height(*it,current_vertices_height);
+          heights[*it]=current_vertices_height;
           num_current_vertices++;
         }
           //std::cerr << "+" << current_vertices.size();
@@ -332,12 +392,26 @@ void TriangleMeshTerrain::do_rivers(const ParametersTerrain& parameters)
 }
 
 void TriangleMeshTerrain::do_colours(const ParametersTerrain& parameters)
+{
+  progress_start(100,"Colouring");
+
+  if (const GeometrySpherical*const g=dynamic_cast<const GeometrySpherical*>(&geometry()))
+    do_colours(GeometryStatic<GeometrySpherical>(*g),parameters);
+  else if (const GeometryFlat*const g=dynamic_cast<const GeometryFlat*>(&geometry()))
+    do_colours(GeometryStatic<GeometryFlat>(*g),parameters);
+  else
+    do_colours(geometry(),parameters);
+
+  progress_complete("Colouring completed");
+}
+
+/*! Vertices are visited in index order, so river membership is found by walking the river set alongside rather than searching it.
+ */
+template <class G> void TriangleMeshTerrain::do_colours(const G& geometry,const ParametersTerrain& parameters)
 {
   const uint steps=triangles_of_colour1()+vertices();
   uint step=0;
 
-  progress_start(100,"Colouring");
-
   // Colour any triangles which need colouring (ie just sea)
   ByteRGBA colour_ocean(parameters.colour_ocean);
   ByteRGBA colour_river(parameters.colour_river);
@@ -366,20 +440,22 @@ void TriangleMeshTerrain::do_colours(const ParametersTerrain& parameters)
   const float beachline=0.01;
 
   // Colour all vertices
+  std::set<uint>::const_iterator river=river_vertices.begin();
   for (uint i=0;i<vertices();i++)
     {
       step++;
       progress_step((100*step)/steps);
 
-      bool is_river=(river_vertices.find(i)!=river_vertices.end());
+      while (river!=river_vertices.end() && *river<i) river++;
+      const bool is_river=(river!=river_vertices.end() && *river==i);
 
-      float average_slope=1.0-(geometry().up(vertex(i).position())%vertex(i).normal());
+      float average_slope=1.0-(geometry.up(vertex(i).position())%vertex(i).normal());
 
-      const float normalised_height=vertex_height(i)/max_height;
+      const float normalised_height=heights[i]/max_height;
 
       float snowline_here=
     parameters.snowline_equator
-    +fabs(geometry().normalised_latitude(vertex(i).position()))*(parameters.snowline_pole-parameters.snowline_equator)
+    +fabs(geometry.normalised_latitude(vertex(i).position()))*(parameters.snowline_pole-parameters.snowline_equator)
     +parameters.snowline_slope_effect*average_slope
     -(is_river ? parameters.snowline_glacier_effect : 0.0);
 
@@ -408,240 +484,321 @@ void TriangleMeshTerrain::do_colours(const ParametersTerrain& parameters)
       vertex(i).colour(0,parameters.colour_high);
     }
     }
-
-  progress_complete("Colouring completed");
 }
 
+/*! Up to river generation the stages work on the height channel alone;
+  positions are only brought into line with it once, before normals (and colours) need them.
+ */
 void TriangleMeshTerrain::do_terrain(const ParametersTerrain& parameters)
 {
+  cache_heights();
   do_noise(parameters);
   do_sea_level(parameters);
   do_power_law(parameters);
   do_rivers(parameters);
+  materialise_heights();
   compute_vertex_normals();
   do_colours(parameters);
   set_emissive(parameters.oceans_and_rivers_emissive);
 }
 
-void TriangleMeshTerrain::write_blender(std::ofstream& out,const ParametersSave&,const ParametersTerrain&,const std::string& mesh_name) const
+/*! River vertices are locked so decimation can't break up the river network.
+ */
+const TriangleMesh& TriangleMeshTerrain::export_mesh(const ParametersSave& param_save,boost::scoped_ptr<TriangleMesh>& decimated) const
 {
-  TriangleMesh::write_blender(out,mesh_name+".terrain",0);
+  if (!param_save.decimate) return *this;
+
+  std::vector<bool> locked(vertices());
+  for (std::set<uint>::const_iterator it=river_vertices.begin();it!=river_vertices.end();it++)
+    locked[*it]=true;
+
+  decimated.reset(new TriangleMeshDecimated(*this,locked,param_save.decimate_triangles,param_save.decimate_error,_progress));
+  return *decimated;
 }
 
-namespace
+void TriangleMeshTerrain::write_blender(std::ostream& out,const std::string& filename_base,const ParametersSave& param_save,const ParametersTerrain&,const std::string& mesh_name) const
 {
-  template <typename T> const T lerp(float l,const T& v0,const T& v1)
-  {
-    return (1.0f-l)*v0+l*v1;
-  }
+  boost::scoped_ptr<TriangleMesh> decimated;
+  export_mesh(param_save,decimated).write_blender(out,filename_base+"_terrain.bin",mesh_name+".terrain",0);
+}
 
-  FloatRGBA fn(const XYZ& v)
-  {
-    const XYZ n(v.normalised());
-    return FloatRGBA(0.5f+0.5f*n.x,0.5f+0.5f*n.y,0.5f+0.5f*n.z,0.0f);
-  }
+void TriangleMeshTerrain::write_gltf(GltfWriter& gltf,const ParametersSave& param_save,const std::string& mesh_name) const
+{
+  boost::scoped_ptr<TriangleMesh> decimated;
+  gltf.add(export_mesh(param_save,decimated),mesh_name+".terrain",false);
+}
+
+void TriangleMeshTerrain::write_mesh(std::ostream& out,const ParametersSave& param_save,const std::string& mesh_name) const
+{
+  boost::scoped_ptr<TriangleMesh> decimated;
+  const TriangleMesh& mesh=export_mesh(param_save,decimated);
+  if (param_save.mesh_obj)
+    mesh.write_obj(out,mesh_name+".terrain");
+  else
+    mesh.write_ply(out,mesh_name+".terrain");
+}
+
+/*! Triangles are rendered in parallel by horizontal bands of the image (see TextureRenderer),
+  with a result identical to rendering them serially.
+ */
+void TriangleMeshTerrain::render_texture
+(
+ Raster<ByteRGBA>& image,
+ Raster<ushort>* dem,
+ Raster<ByteRGBA>* normal_map,
+ bool shading,
+ float ambient,
+ const XYZ& illumination
+ ) const
+{
+  progress_start(100,"Generating textures");
+
+  const TerrainTextureLayer layer(*this,heights,shading,ambient,illumination);
+  TextureRenderer<TerrainTextureLayer> renderer(layer,image.width(),image.height());
+  renderer.find_extents();
+
+  const std::vector<uint> all(renderer.all());
+  const TerrainTextureTarget target(TextureRows(image.width(),image.height(),0,0,image.height()),image,dem,normal_map);
+
+  parallel_for
+    (
+     image.height(),
+     boost::bind(&TextureRenderer<TerrainTextureLayer>::render_rows,&renderer,boost::cref(all),boost::cref(target),_1,_2),
+     boost::bind(&TriangleMeshTerrain::progress_step,this,_1)
+     );
+
+  progress_complete("Texture generation completed");
+}
 
-  class ScanConvertHelper : public ScanConvertBackend
+namespace
+{
+  //! Renders rows of a band of terrain texture, and of cloud texture if there is one, for parallel_for.
+  class TerrainCloudBand
   {
   public:
-    ScanConvertHelper
+    TerrainCloudBand
     (
-     Raster<ByteRGBA>& image,
-     Raster<ushort>* dem,
-     Raster<ByteRGBA>* normalmap,
-     const boost::array<FloatRGBA,3>& vertex_colours,
-     const boost::array<float,3>& vertex_heights,
-     const boost::array<XYZ,3>& vertex_normals
+     const TextureRenderer<TerrainTextureLayer>& terrain,
+     const std::vector<uint>& terrain_triangles,
+     const TerrainTextureTarget& terrain_target,
+     const TextureRenderer<CloudTextureLayer>* cloud,
+     const std::vector<uint>* cloud_triangles,
+     const CloudTextureTarget* cloud_target
      )
-      :ScanConvertBackend(image.width(),image.height())
-       ,_image(image)
-       ,_dem(dem)
-       ,_normalmap(normalmap)
-       ,_vertex_colours(vertex_colours)
-       ,_vertex_heights(vertex_heights)
-       ,_vertex_normals(vertex_normals)
+      :_terrain(terrain)
+      ,_terrain_triangles(terrain_triangles)
+      ,_terrain_target(terrain_target)
+      ,_cloud(cloud)
+      ,_cloud_triangles(cloud_triangles)
+      ,_cloud_target(cloud_target)
+    {}
+    void operator()(uint begin,uint end) const
     {
-      if (_dem) assert(_image.width()==_dem->width() && _image.height()==_dem->height());
-      if (_normalmap) assert(_image.width()==_normalmap->width() && _image.height()==_normalmap->height());
+      _terrain.render_rows(_terrain_triangles,_terrain_target,begin,end);
+      if (_cloud) _cloud->render_rows(*_cloud_triangles,*_cloud_target,begin,end);
     }
-    virtual ~ScanConvertHelper()
-    {}
+  private:
+    const TextureRenderer<TerrainTextureLayer>& _terrain;
+    const std::vector<uint>& _terrain_triangles;
+    const TerrainTextureTarget& _terrain_target;
+    const TextureRenderer<CloudTextureLayer>*const _cloud;
+    const std::vector<uint>*const _cloud_triangles;
+    const CloudTextureTarget*const _cloud_target;
+  };
 
-    virtual void scan_convert_backend(uint y,const ScanEdge& edge0,const ScanEdge& edge1) const
+  //! Renders rows of a band of each of the six faces of a cube map, for parallel_for (which sees the faces' rows end to end).
+  class CubeMapBand
+  {
+  public:
+    CubeMapBand(const std::vector<boost::shared_ptr<TerrainCloudBand> >& faces,uint rows)
+      :_faces(faces)
+      ,_rows(rows)
+    {}
+    void operator()(uint begin,uint end) const
     {
-      const FloatRGBA c0=lerp(edge0.lambda,_vertex_colours[edge0.vertex0],_vertex_colours[edge0.vertex1]);
-      const FloatRGBA c1=lerp(edge1.lambda,_vertex_colours[edge1.vertex0],_vertex_colours[edge1.vertex1]);
-      _image.scan(y,edge0.x,c0,edge1.x,c1);
+      for (uint f=0;f<_faces.size();f++)
+        {
+          const uint face_begin=std::max(begin,f*_rows);
+          const uint face_end=std::min(end,(f+1)*_rows);
+          if (face_begin<face_end) (*_faces[f])(face_begin-f*_rows,face_end-f*_rows);
+        }
+    }
+  private:
+    const std::vector<boost::shared_ptr<TerrainCloudBand> >& _faces;
+    const uint _rows;
+  };
 
-      if (_dem)
+  //! A band of texture rows, and (as requested) of DEM, normal map and cloud rows, with the targets drawing into them.
+  /*! The images start out transparent black, zero height, flat (128,128,128) normals and zero cloud respectively.
+   */
+  class TextureBandImages : public boost::noncopyable
+  {
+  public:
+    TextureBandImages(const TextureRows& rows,bool dem,bool normal_map,bool cloud)
+      :_image(rows.width(),rows.row_end()-rows.row_begin())
+      ,_dem(dem ? new Image<ushort>(rows.width(),rows.row_end()-rows.row_begin()) : 0)
+      ,_normal_map(normal_map ? new Image<ByteRGBA>(rows.width(),rows.row_end()-rows.row_begin()) : 0)
+      ,_cloud(cloud ? new Image<uchar>(rows.width(),rows.row_end()-rows.row_begin()) : 0)
+      ,_terrain_target(rows,_image,_dem.get(),_normal_map.get())
+      ,_cloud_target(cloud ? new CloudTextureTarget(rows,*_cloud) : 0)
     {
-      const float h0=lerp(edge0.lambda,_vertex_heights[edge0.vertex0],_vertex_heights[edge0.vertex1]);
-      const float h1=lerp(edge1.lambda,_vertex_heights[edge1.vertex0],_vertex_heights[edge1.vertex1]);
-      _dem->scan(y,edge0.x,h0,edge1.x,h1);
+      _image.fill(ByteRGBA(0,0,0,0));
+      if (_dem) _dem->fill(0);
+      if (_normal_map) _normal_map->fill(ByteRGBA(128,128,128,0));
+      if (_cloud) _cloud->fill(0);
     }
-      if (_normalmap)
+    const TerrainTextureTarget& terrain_target() const
     {
-      const XYZ n0(lerp(edge0.lambda,_vertex_normals[edge0.vertex0],_vertex_normals[edge0.vertex1]).normalised());
-      const XYZ n1(lerp(edge1.lambda,_vertex_normals[edge1.vertex0],_vertex_normals[edge1.vertex1]).normalised());
-      _normalmap->scan<XYZ>(y,edge0.x,n0,edge1.x,n1,fn);
+      return _terrain_target;
     }
+    const CloudTextureTarget* cloud_target() const
+    {
+      return _cloud_target.get();
     }
-
-    virtual void subdivide(const boost::array<XYZ,3>& v,const XYZ& m,const ScanConverter& scan_converter) const
+    //! Pass the band to a sink.
+    bool send(const TriangleMeshTerrain::TextureBandSink& sink) const
     {
-      // Subdivision pattern (into 7) avoids creating any mid-points in edges shared with other triangles.
-      const boost::array<XYZ,3> vm=
-    {{
-      (v[1]+v[2]+m)/3.0f,
-      (v[0]+v[2]+m)/3.0f,
-      (v[0]+v[1]+m)/3.0f
-    }};
-
-      //! \todo This isn't right (for correct value would need to compute barycentric coordinates of m), but it will should only affect one facet at the pole.
-      const boost::array<FloatRGBA,3> cm=
-    {{
-      0.5f*(_vertex_colours[1]+_vertex_colours[2]),
-      0.5f*(_vertex_colours[0]+_vertex_colours[2]),
-      0.5f*(_vertex_colours[0]+_vertex_colours[1])
-    }};
-      const boost::array<float,3> hm=
-    {{
-      0.5f*(_vertex_heights[1]+_vertex_heights[2]),
-      0.5f*(_vertex_heights[0]+_vertex_heights[2]),
-      0.5f*(_vertex_heights[0]+_vertex_heights[1])
-    }};
-      const boost::array<XYZ,3> nm=
-    {{
-      (_vertex_normals[1]+_vertex_normals[2]).normalised(),
-      (_vertex_normals[0]+_vertex_normals[2]).normalised(),
-      (_vertex_normals[0]+_vertex_normals[1]).normalised()
-    }};
-
-      {
-    const boost::array<XYZ,3> p={{v[0],v[1],vm[2]}};
-    const boost::array<FloatRGBA,3> c={{_vertex_colours[0],_vertex_colours[1],cm[2]}};
-    const boost::array<float,3> h={{_vertex_heights[0],_vertex_heights[1],hm[2]}};
-    const boost::array<XYZ,3> n={{_vertex_normals[0],_vertex_normals[1],nm[2]}};
-    scan_converter.scan_convert(p,ScanConvertHelper(_image,_dem,_normalmap,c,h,n));
-      }
-
-      {
-    const boost::array<XYZ,3> p={{v[1],v[2],vm[0]}};
-    const boost::array<FloatRGBA,3> c={{_vertex_colours[1],_vertex_colours[2],cm[0]}};
-    const boost::array<float,3> h={{_vertex_heights[1],_vertex_heights[2],hm[0]}};
-    const boost::array<XYZ,3> n={{_vertex_normals[1],_vertex_normals[2],nm[0]}};
-    scan_converter.scan_convert(p,ScanConvertHelper(_image,_dem,_normalmap,c,h,n));
-      }
-
-      {
-    const boost::array<XYZ,3> p={{v[2],v[0],vm[1]}};
-    const boost::array<FloatRGBA,3> c={{_vertex_colours[2],_vertex_colours[0],cm[1]}};
-    const boost::array<float,3> h={{_vertex_heights[2],_vertex_heights[0],hm[1]}};
-    const boost::array<XYZ,3> n={{_vertex_normals[2],_vertex_normals[0],nm[1]}};
-    scan_converter.scan_convert(p,ScanConvertHelper(_image,_dem,_normalmap,c,h,n));
-      }
-
-      {
-    const boost::array<XYZ,3> p={{v[0],vm[2],vm[1]}};
-    const boost::array<FloatRGBA,3> c={{_vertex_colours[0],cm[2],cm[1]}};
-    const boost::array<float,3> h={{_vertex_heights[0],hm[2],hm[1]}};
-    const boost::array<XYZ,3> n={{_vertex_normals[0],nm[2],nm[1]}};
-    scan_converter.scan_convert(p,ScanConvertHelper(_image,_dem,_normalmap,c,h,n));
-      }
+      return sink(_image,_dem.get(),_normal_map.get(),_cloud.get());
+    }
+  private:
+    Image<ByteRGBA> _image;
+    const boost::scoped_ptr<Image<ushort> > _dem;
+    const boost::scoped_ptr<Image<ByteRGBA> > _normal_map;
+    const boost::scoped_ptr<Image<uchar> > _cloud;
+    const TerrainTextureTarget _terrain_target;
+    const boost::scoped_ptr<CloudTextureTarget> _cloud_target;
+  };
+}
 
-      {
-    const boost::array<XYZ,3> p={{v[1],vm[0],vm[2]}};
-    const boost::array<FloatRGBA,3> c={{_vertex_colours[1],cm[0],cm[2]}};
-    const boost::array<float,3> h={{_vertex_heights[1],hm[0],hm[2]}};
-    const boost::array<XYZ,3> n={{_vertex_normals[1],nm[0],nm[2]}};
-    scan_converter.scan_convert(p,ScanConvertHelper(_image,_dem,_normalmap,c,h,n));
-      }
+/*! Each renderer sweeps down the texture keeping the list (in mesh order) of its triangles touching the current band.
+  Each band's terrain and cloud rows are rendered together in one parallel pass, as render_texture does,
+  so bands are identical to the corresponding rows of a whole texture.
+ */
+bool TriangleMeshTerrain::render_texture_bands
+(
+ uint width,
+ uint height,
+ uint band_height,
+ bool dem,
+ bool normal_map,
+ const TriangleMesh* cloud,
+ bool shading,
+ float ambient,
+ const XYZ& illumination,
+ const TextureBandSink& sink
+ ) const
+{
+  progress_start(100,"Generating textures");
 
-      {
-    const boost::array<XYZ,3> p={{v[2],vm[1],vm[0]}};
-    const boost::array<FloatRGBA,3> c={{_vertex_colours[2],cm[1],cm[0]}};
-    const boost::array<float,3> h={{_vertex_heights[2],hm[1],hm[0]}};
-    const boost::array<XYZ,3> n={{_vertex_normals[2],nm[1],nm[0]}};
-    scan_converter.scan_convert(p,ScanConvertHelper(_image,_dem,_normalmap,c,h,n));
-      }
+  const TerrainTextureLayer terrain_layer(*this,heights,shading,ambient,illumination);
+  TextureRenderer<TerrainTextureLayer> terrain_renderer(terrain_layer,width,height);
+  terrain_renderer.find_extents();
 
-      {
-    scan_converter.scan_convert(vm,ScanConvertHelper(_image,_dem,_normalmap,cm,hm,nm));
-      }
+  boost::scoped_ptr<CloudTextureLayer> cloud_layer(cloud ? new CloudTextureLayer(*cloud) : 0);
+  boost::scoped_ptr<TextureRenderer<CloudTextureLayer> > cloud_renderer(cloud ? new TextureRenderer<CloudTextureLayer>(*cloud_layer,width,height) : 0);
+  if (cloud_renderer) cloud_renderer->find_extents();
 
+  bool ok=true;
+  for (uint band_begin=0;ok && band_begin<height;band_begin+=band_height)
+    {
+      const uint band_end=std::min(height,band_begin+band_height);
+      const TextureBandImages band(TextureRows(width,height,band_begin,band_begin,band_end),dem,normal_map,cloud!=0);
+
+      parallel_for
+        (
+         band_end-band_begin,
+         TerrainCloudBand
+         (
+          terrain_renderer,
+          terrain_renderer.band(band_begin,band_end),
+          band.terrain_target(),
+          cloud_renderer.get(),
+          (cloud_renderer ? &cloud_renderer->band(band_begin,band_end) : 0),
+          band.cloud_target()
+          )
+         );
+
+      ok=band.send(sink);
+
+      progress_step((100*band_end)/height);
     }
 
-  private:
-    Raster<ByteRGBA>& _image;
-    Raster<ushort>* _dem;
-    Raster<ByteRGBA>* _normalmap;
-    const boost::array<FloatRGBA,3>& _vertex_colours;
-    const boost::array<float,3>& _vertex_heights;
-    const boost::array<XYZ,3>& _vertex_normals;
-  };
+  progress_complete("Texture generation completed");
+  return ok;
 }
 
-void TriangleMeshTerrain::render_texture
+/*! As render_texture_bands, but each band has the same rows of all six faces, which are rendered together in one parallel pass.
+  Each face has its own renderers, so triangles are only scanned into the faces they overlap.
+ */
+bool TriangleMeshTerrain::render_cube_map_bands
 (
- Raster<ByteRGBA>& image,
- Raster<ushort>* dem,
- Raster<ByteRGBA>* normal_map,
+ uint size,
+ uint band_height,
+ bool dem,
+ bool normal_map,
+ const TriangleMesh* cloud,
  bool shading,
  float ambient,
- const XYZ& illumination
+ const XYZ& illumination,
+ const CubeMapBandSink& sink
  ) const
 {
-  progress_start(100,"Generating textures");
+  progress_start(100,"Generating cube map textures");
+
+  const TerrainTextureLayer terrain_layer(*this,heights,shading,ambient,illumination);
+  boost::scoped_ptr<CloudTextureLayer> cloud_layer(cloud ? new CloudTextureLayer(*cloud) : 0);
+
+  std::vector<CubeMapFace> faces;
+  for (uint f=0;f<6;f++)
+    faces.push_back(CubeMapFace(f));
 
-  for (uint i=0;i<triangles();i++)
+  std::vector<boost::shared_ptr<TextureRenderer<TerrainTextureLayer> > > terrain_renderers;
+  std::vector<boost::shared_ptr<TextureRenderer<CloudTextureLayer> > > cloud_renderers;
+  for (uint f=0;f<6;f++)
     {
-      const Triangle& t=triangle(i);
-      const boost::array<const Vertex*,3> vertices
-    ={{
-      &vertex(t.vertex(0)),
-      &vertex(t.vertex(1)),
-      &vertex(t.vertex(2)),
-    }};
-
-      const boost::array<XYZ,3> vertex_positions
-    ={{
-      vertices[0]->position(),
-      vertices[1]->position(),
-      vertices[2]->position()
-    }};
-
-      const uint which_colour=(i<triangles_of_colour0() ? 0 : 1);
-      const boost::array<FloatRGBA,3> vertex_colours
-    ={{
-      FloatRGBA(vertices[0]->colour(which_colour))*(shading ? ambient+(1.0f-ambient)*std::max(0.0f,vertices[0]->normal()%illumination) : 1.0f),
-      FloatRGBA(vertices[1]->colour(which_colour))*(shading ? ambient+(1.0f-ambient)*std::max(0.0f,vertices[1]->normal()%illumination) : 1.0f),
-      FloatRGBA(vertices[2]->colour(which_colour))*(shading ? ambient+(1.0f-ambient)*std::max(0.0f,vertices[2]->normal()%illumination) : 1.0f)
-    }};
-      const boost::array<float,3> vertex_heights
-    ={{
-      std::max(0.0f,std::min(65535.0f,65535.0f*geometry().height(vertices[0]->position()))),
-      std::max(0.0f,std::min(65535.0f,65535.0f*geometry().height(vertices[1]->position()))),
-      std::max(0.0f,std::min(65535.0f,65535.0f*geometry().height(vertices[2]->position())))
-    }};
-      const boost::array<XYZ,3> vertex_normals
-    ={{
-      vertices[0]->normal(),
-      vertices[1]->normal(),
-      vertices[2]->normal()
-    }};
-
-      ScanConvertHelper backend(image,dem,normal_map,vertex_colours,vertex_heights,vertex_normals);
-
-      geometry().scan_convert
-    (
-     vertex_positions,
-     backend
-     );
+      terrain_renderers.push_back(boost::shared_ptr<TextureRenderer<TerrainTextureLayer> >(new TextureRenderer<TerrainTextureLayer>(terrain_layer,size,size,&faces[f])));
+      terrain_renderers.back()->find_extents();
+      cloud_renderers.push_back(boost::shared_ptr<TextureRenderer<CloudTextureLayer> >(cloud ? new TextureRenderer<CloudTextureLayer>(*cloud_layer,size,size,&faces[f]) : 0));
+      if (cloud_renderers.back()) cloud_renderers.back()->find_extents();
+    }
 
-      progress_step((100*i)/(triangles()-1));
+  bool ok=true;
+  for (uint band_begin=0;ok && band_begin<size;band_begin+=band_height)
+    {
+      const uint band_end=std::min(size,band_begin+band_height);
+
+      std::vector<boost::shared_ptr<TextureBandImages> > bands;
+      std::vector<boost::shared_ptr<TerrainCloudBand> > face_bands;
+      for (uint f=0;f<6;f++)
+        {
+          bands.push_back(boost::shared_ptr<TextureBandImages>(new TextureBandImages(TextureRows(size,size,band_begin,band_begin,band_end),dem,normal_map,cloud!=0)));
+          face_bands.push_back
+            (
+             boost::shared_ptr<TerrainCloudBand>
+             (
+              new TerrainCloudBand
+              (
+               *terrain_renderers[f],
+               terrain_renderers[f]->band(band_begin,band_end),
+               bands[f]->terrain_target(),
+               cloud_renderers[f].get(),
+               (cloud_renderers[f] ? &cloud_renderers[f]->band(band_begin,band_end) : 0),
+               bands[f]->cloud_target()
+               )
+              )
+             );
+        }
+
+      parallel_for(6*(band_end-band_begin),CubeMapBand(face_bands,band_end-band_begin));
+
+      for (uint f=0;ok && f<6;f++)
+        ok=bands[f]->send(boost::bind(sink,f,_1,_2,_3,_4));
+
+      progress_step((100*band_end)/size);
     }
 
-  progress_complete("Texture generation completed");
+  progress_complete("Cube map texture generation completed");
+  return ok;
 }
 
 TriangleMeshTerrainPlanet::TriangleMeshTerrainPlanet(const ParametersTerrain& parameters,Progress* progress)
@@ -652,7 +809,7 @@ TriangleMeshTerrainPlanet::TriangleMeshTerrainPlanet(const ParametersTerrain& pa
   do_terrain(parameters);
 }
 
-void TriangleMeshTerrainPlanet::write_povray(std::ofstream& out,const ParametersSave& param_save,const ParametersTerrain& parameters_terrain) const
+void TriangleMeshTerrainPlanet::write_povray(std::ostream& out,const ParametersSave& param_save,const ParametersTerrain& parameters_terrain) const
 {
   if (param_save.pov_sea_object)
     {
@@ -673,7 +830,8 @@ void TriangleMeshTerrainPlanet::write_povray(std::ofstream& out,const Parameters
     << "sphere {<0.0,0.0,0.0>,1.05  hollow texture {pigment {color rgbf 1}} interior{media{scattering{1,color rgb <0.0,0.0,1.0> extinction 1}}}}\n";
     }
 
-  TriangleMesh::write_povray(out,param_save.pov_sea_object,false,false); // Don't double illuminate.  Don't no-shadow.
+  boost::scoped_ptr<TriangleMesh> decimated;
+  export_mesh(param_save,decimated).write_povray(out,param_save.pov_sea_object,false,false,(param_save.pov_palette ? param_save.pov_palette_bits : 0)); // Don't double illuminate.  Don't no-shadow.
 }
 
 TriangleMeshTerrainFlat::TriangleMeshTerrainFlat(const ParametersTerrain& parameters,Progress* progress)
@@ -686,7 +844,7 @@ TriangleMeshTerrainFlat::TriangleMeshTerrainFlat(const ParametersTerrain& parame
   do_terrain(parameters);
 }
 
-void TriangleMeshTerrainFlat::write_povray(std::ofstream& out,const ParametersSave& param_save,const ParametersTerrain& parameters_terrain) const
+void TriangleMeshTerrainFlat::write_povray(std::ostream& out,const ParametersSave& param_save,const ParametersTerrain& parameters_terrain) const
 {
   if (param_save.pov_sea_object)
     {
@@ -707,5 +865,6 @@ void TriangleMeshTerrainFlat::write_povray(std::ofstream& out,const ParametersSa
     << "plane {<0.0,1.0,0.0>,0.1  hollow texture {pigment {color rgbf 1}} interior{media{scattering{1,color rgb <0.0,0.0,1.0> extinction 1}}}}\n";
     }
 
-  TriangleMesh::write_povray(out,param_save.pov_sea_object,false,false); // Don't double illuminate.  Don't no-shadow.
+  boost::scoped_ptr<TriangleMesh> decimated;
+  export_mesh(param_save,decimated).write_povray(out,param_save.pov_sea_object,false,false,(param_save.pov_palette ? param_save.pov_palette_bits : 0)); // Don't double illuminate.  Don't no-shadow.
 }
@@ -24,6 +24,7 @@
 #ifndef _triangle_mesh_terrain_h_
 #define _triangle_mesh_terrain_h_
 
+#include "gltf_writer.h"
 #include "image.h"
 #include "parameters_terrain.h"
 #include "triangle_mesh.h"
@@ -46,17 +47,64 @@ class TriangleMeshTerrain : virtual public TriangleMesh
   //! Dump the model as a POV scene.
   /*! Virtual method because spherical and flat terrains need e.g different sea-level planes and atmosphere layers.
    */
-  virtual void write_povray(std::ofstream& out,const ParametersSave&,const ParametersTerrain&) const
+  virtual void write_povray(std::ostream& out,const ParametersSave&,const ParametersTerrain&) const
     =0;
 
-  //! Dump the model for Blender.
+  //! Dump the model for Blender (its data going to filename_base+"_terrain.bin").
   /*! Unlike write_povray there are no specialisations for flat/spherical terrain.
    */
-  virtual void write_blender(std::ofstream& out,const ParametersSave&,const ParametersTerrain&,const std::string& mesh_name) const;
+  virtual void write_blender(std::ostream& out,const std::string& filename_base,const ParametersSave&,const ParametersTerrain&,const std::string& mesh_name) const;
+
+  //! Add the model to a glTF file.
+  void write_gltf(GltfWriter& gltf,const ParametersSave&,const std::string& mesh_name) const;
+
+  //! Dump the model as PLY or OBJ (as selected by the save parameters).
+  void write_mesh(std::ostream& out,const ParametersSave&,const std::string& mesh_name) const;
 
   //! Render the mesh onto raster images (colour texture, and optionally 16-bit DEM and/or normal map).
   virtual void render_texture(Raster<ByteRGBA>&,Raster<ushort>*,Raster<ByteRGBA>*,bool shading,float ambient,const XYZ& illumination) const;
 
+  //! Receives a band of texture, DEM, normal map and cloud rows (the last three null unless requested).
+  typedef boost::function<bool (const Raster<ByteRGBA>&,const Raster<ushort>*,const Raster<ByteRGBA>*,const Raster<uchar>*)> TextureBandSink;
+
+  //! Render a width by height texture (and optionally 16-bit DEM, normal map and/or a cloud mesh's alpha) a band of rows at a time, passing each band to sink in turn.
+  /*! Only one band (of at most band_height rows) is held in memory at once, so the texture can be far larger than would fit whole.
+    Bands start out transparent black, zero height, flat (128,128,128) normals and zero cloud respectively.
+    Rendering stops early, returning false, if sink does.
+   */
+  bool render_texture_bands
+    (
+     uint width,
+     uint height,
+     uint band_height,
+     bool dem,
+     bool normal_map,
+     const TriangleMesh* cloud,
+     bool shading,
+     float ambient,
+     const XYZ& illumination,
+     const TextureBandSink& sink
+     ) const;
+
+  //! Receives a band of one face (numbered as CubeMapFace) of a cube map, as TextureBandSink.
+  typedef boost::function<bool (uint,const Raster<ByteRGBA>&,const Raster<ushort>*,const Raster<ByteRGBA>*,const Raster<uchar>*)> CubeMapBandSink;
+
+  //! Render a cube map (six size by size faces) of a spherical terrain, as render_texture_bands renders its usual texture.
+  /*! Each band has the same rows of all six faces, passed to sink one face after another.
+   */
+  bool render_cube_map_bands
+    (
+     uint size,
+     uint band_height,
+     bool dem,
+     bool normal_map,
+     const TriangleMesh* cloud,
+     bool shading,
+     float ambient,
+     const XYZ& illumination,
+     const CubeMapBandSink& sink
+     ) const;
+
  protected:
 
   //! Indices of the set of triangles with all vertices at sea-level
@@ -68,6 +116,22 @@ class TriangleMeshTerrain : virtual public TriangleMesh
   //! Maximum height of terrain (used to scale to/from "normalised" height).
   float max_height;
 
+  //! Height of each vertex.
+  /*! Authoritative while the terrain is being generated, so height-only stages need no square roots:
+    vertex positions keep their direction but only take on these heights when materialise_heights() is called.
+    Kept afterwards (when the two agree) for rendering the DEM.
+   */
+  std::vector<float> heights;
+
+  //! Initialise heights from the vertex positions.
+  void cache_heights();
+
+  //! Move the vertex positions to the cached heights.
+  void materialise_heights();
+
+  //! The mesh to export: either this one, or a decimated copy (owned by decimated) if the save parameters request it.
+  const TriangleMesh& export_mesh(const ParametersSave&,boost::scoped_ptr<TriangleMesh>& decimated) const;
+
   //! Add noise to the terrain
   void do_noise(const ParametersTerrain& parameters);
 
@@ -85,6 +149,17 @@ class TriangleMeshTerrain : virtual public TriangleMesh
 
   //! Invokes all the above steps (sea-level through final colouring) on a pre-subdivided triangle mesh.
   void do_terrain(const ParametersTerrain& parameters);
+
+ private:
+
+  //! Body of cache_heights, bound to a specific geometry type.
+  template <class G> void cache_heights(const G& geometry);
+
+  //! Body of materialise_heights, bound to a specific geometry type.
+  template <class G> void materialise_heights(const G& geometry);
+
+  //! Body of do_colours, bound to a specific geometry type.
+  template <class G> void do_colours(const G& geometry,const ParametersTerrain& parameters);
 };
 
 //! Class constructing specific case of a planetary terrain.
@@ -100,7 +175,7 @@ class TriangleMeshTerrainPlanet : public TriangleMeshSubdividedIcosahedron, virt
     {}
 
   //! Specifc dump-to-povray for planet terrain.
-  void write_povray(std::ofstream& out,const ParametersSave&,const ParametersTerrain&) const;
+  void write_povray(std::ostream& out,const ParametersSave&,const ParametersTerrain&) const;
 };
 
 //! Class constructing specific case of a flat-base terrain area.
@@ -116,7 +191,7 @@ class TriangleMeshTerrainFlat : public TriangleMeshFlat, virtual public Triangle
     {}
 
   //! Specifc dump-to-povray for flat terrain area.
-  void write_povray(std::ofstream& out,const ParametersSave&,const ParametersTerrain&) const;
+  void write_povray(std::ostream& out,const ParametersSave&,const ParametersTerrain&) const;
 };
 
 #endif
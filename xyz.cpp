@@ -21,6 +21,8 @@
 
 #include "xyz.h"
 
+#include "text_format.h"
+
 /*! Table so we can look up by element number.
  */
 XYZ::ElementPtr XYZ::element_table[3]={&XYZ::x,&XYZ::y,&XYZ::z};
@@ -37,20 +39,24 @@ const std::string XYZ::format_comma() const
   return s.str();
 }
 
-const std::string XYZ::format_blender() const
-{
-  std::ostringstream s;
-  s << x << ", " << y << ", " << z;
-  return s.str();
-}
-
 /*! Also transposes y and z co-ordinates because of POV-Rays idea of up.
  */
 const std::string XYZ::format_pov() const
 {
-  std::ostringstream s;
-  s << "<" << x << "," << z << "," << y << ">";
-  return s.str();
+  std::string s;
+  append_pov(s);
+  return s;
+}
+
+void XYZ::append_pov(std::string& s) const
+{
+  s+='<';
+  append_number(s,x);
+  s+=',';
+  append_number(s,z);
+  s+=',';
+  append_number(s,y);
+  s+='>';
 }
 
 RandomXYZInUnitCube::RandomXYZInUnitCube(Random01& rng)
@@ -145,11 +145,11 @@ class XYZ
   //! Alternate formatting.
   const std::string format_comma() const;
 
-  //! Alternate formatting.
-  const std::string format_blender() const;
-
   //! Alternate formatting.
   const std::string format_pov() const;
+
+  //! As format_pov, but appended to s (without the overhead of a stream).
+  void append_pov(std::string& s) const;
 };
 
 //! Cross product.